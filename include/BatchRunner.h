@@ -0,0 +1,64 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "Grid.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <utility>
+
+struct BatchSettings
+{
+	int worldCount{ 8 };
+	int ticks{ 1000 };
+	int rows{ 256 };
+	int columns{ 256 };
+	GridLayout layout{ GridLayout::RowMajor };
+	// world i runs with seed + i
+	uint64_t seed{};
+	float fixedTimeStep{ 1.f / 60.f };
+};
+
+struct BatchWorldResult
+{
+	uint64_t seed{};
+	double seconds{};
+	double ticksPerSecond{};
+	// chunks that would still be updated on the next tick, 0 once the world has settled
+	int activeChunks{};
+	std::vector<std::pair<std::string, int>> elementCounts{};
+};
+
+// Runs many independent worlds without a window, for parameter sweeps and benchmarks.
+// Every world is a single job on the job system and updates serially inside it,
+// so the worlds spread over the cores instead of contending for the chunks of one grid.
+class BatchRunner final
+{
+public:
+	// Fills a world before its first tick
+	using WorldSetup = std::function<void(Grid& grid, int worldIndex)>;
+
+	explicit BatchRunner(const BatchSettings& settings);
+	~BatchRunner() = default;
+
+	BatchRunner(const BatchRunner& other) = delete;
+	BatchRunner& operator=(const BatchRunner& other) = delete;
+	BatchRunner(BatchRunner&& other) = delete;
+	BatchRunner& operator=(BatchRunner&& other) = delete;
+
+	// Defaults to a few seeded blobs of the default elements on some wall ledges
+	void SetWorldSetup(WorldSetup setup) { m_WorldSetup = std::move(setup); };
+	// Runs every world for the set number of ticks and prints a line per world
+	void Run();
+	const std::vector<BatchWorldResult>& GetResults() const { return m_Results; };
+private:
+	BatchSettings m_Settings{};
+	WorldSetup m_WorldSetup{};
+	std::vector<BatchWorldResult> m_Results{};
+
+	BatchWorldResult RunWorld(int worldIndex) const;
+	void SetupDefaultWorld(Grid& grid, int worldIndex) const;
+	void PrintResults(double totalSeconds) const;
+};
+
+#endif // !BATCHRUNNER_H
@@ -6,6 +6,8 @@
 #include <vector>
 #include <random>
 #include <memory>
+#include <thread>
+#include <atomic>
 
 class CPUSandSimulation final : public ISandSimulation
 {
@@ -21,13 +23,18 @@ public:
 	bool IsActive() const override;
 	inline float GetFixedTimeStep() const override;
 	void SetFixedTimeStep(float fixedTimeStep) override;
+	void SetThreaded(bool isThreaded) override;
 private:
-	bool m_IsSimulating{ true };
+	std::atomic<bool> m_IsSimulating{ true };
+	std::atomic<bool> m_IsStepRequested{};
 	std::unique_ptr<Grid> m_pGrid{};
 	Window* m_pWindow{};
-	float m_FixedTimeStep{};
+	// declared last so it is stopped before the grid goes away
+	std::jthread m_SimulationThread{};
 
 	void Init() override;
+	void Step();
+	void SimulationLoop(std::stop_token stopToken);
 };
 
 #endif // !CPUSANDSIMULATION_H
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef CELL_H
+#define CELL_H
+
+#include "ElementRegistry.h"
+#include <cstdint>
+
+// The hot state of a cell, packed in one word that is stored directly in the grid
+// so neighbour checks never have to leave the grid's memory.
+// bits  0 -  7 : ElementTypeID (EMPTY_TYPE for an empty cell, the whole word is 0 then)
+// bits  8 - 15 : tint adjustment (-128 to 127)
+// bits 16 - 23 : update stamp, the grid's frame counter of the last tick the element was updated
+// bit  24      : claimed by a thread during the optimistic parallel update, see Grid::SwapElements
+// bits 25 - 31 : unused
+using Cell = uint32_t;
+
+constexpr Cell EMPTY_CELL_STATE = 0;
+// A claimed cell never compares equal to EMPTY_CELL_STATE, so other threads see it as taken
+constexpr Cell CLAIMED_CELL_BIT = Cell{ 1 } << 24;
+
+constexpr Cell MakeCell(ElementTypeID typeID, int8_t tint)
+{
+	return Cell{ typeID } | (Cell{ static_cast<uint8_t>(tint) } << 8);
+}
+
+constexpr ElementTypeID GetCellType(Cell cell) { return static_cast<ElementTypeID>(cell & 0xFF); }
+constexpr int8_t GetCellTint(Cell cell) { return static_cast<int8_t>((cell >> 8) & 0xFF); }
+constexpr Cell SetCellType(Cell cell, ElementTypeID typeID) { return (cell & ~Cell{ 0xFF }) | typeID; }
+
+// Comparing the stamp against the frame counter replaces resetting a "has moved" flag on every element after each tick.
+// An element asleep for an exact multiple of 256 ticks waits one extra tick, which is not noticeable.
+constexpr uint8_t GetCellStamp(Cell cell) { return static_cast<uint8_t>((cell >> 16) & 0xFF); }
+constexpr Cell SetCellStamp(Cell cell, uint8_t stamp) { return (cell & ~(Cell{ 0xFF } << 16)) | (Cell{ stamp } << 16); }
+
+constexpr Cell BORDER_CELL_STATE = MakeCell(BORDER_TYPE, 0);
+
+#endif // !CELL_H
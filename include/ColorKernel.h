@@ -0,0 +1,28 @@
+#ifndef COLORKERNEL_H
+#define COLORKERNEL_H
+
+#include "Cell.h"
+#include <cstdint>
+#include <algorithm>
+
+// Color of a single cell, see ConvertCellColors
+inline uint32_t ConvertCellColor(Cell cell, const uint32_t* pColors)
+{
+	const uint32_t baseColor = pColors[GetCellType(cell)];
+	const int tint = GetCellTint(cell);
+
+	uint32_t color{};
+	for (int shift{}; shift <= 16; shift += 8)
+	{
+		const int channel = std::clamp(static_cast<int>((baseColor >> shift) & 0xFF) + tint, 0, 255);
+		color |= static_cast<uint32_t>(channel) << shift;
+	}
+	return color;
+}
+
+// Converts cells to RGB888 pixels: the base color of the cell's type (colors[GetCellType(cell)], so colors[EMPTY_TYPE]
+// is what empty cells show) with the cell's tint added to every channel, saturating at 0 and 255.
+// Runs the version for the instruction set picked in SimdKernels.
+void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels);
+
+#endif // !COLORKERNEL_H
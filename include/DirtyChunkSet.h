@@ -0,0 +1,90 @@
+#ifndef DIRTYCHUNKSET_H
+#define DIRTYCHUNKSET_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Inclusive bounds, in grid cells, of the part of a chunk that needs updating
+struct DirtyRect
+{
+	int minX{};
+	int minY{};
+	int maxX{};
+	int maxY{};
+};
+
+// Set of chunk indices stored as a packed bitset, plus the list of indices in the set.
+// Marking, clearing and walking the set only cost as much as the number of chunks in it.
+// Every chunk in the set also keeps the bounding rectangle of everything marked in it.
+class DirtyChunkSet final
+{
+public:
+	void Resize(int chunkCount)
+	{
+		m_Bits.assign((chunkCount + 63) / 64, 0);
+		m_Rects.assign(chunkCount, {});
+		m_ActiveChunks.clear();
+		m_ActiveChunks.reserve(chunkCount);
+	}
+
+	bool IsDirty(int chunkIndex) const
+	{
+		return (m_Bits[chunkIndex >> 6] >> (chunkIndex & 63)) & 1;
+	}
+
+	void Mark(int chunkIndex, const DirtyRect& rect)
+	{
+		uint64_t& word = m_Bits[chunkIndex >> 6];
+		const uint64_t bit = uint64_t{ 1 } << (chunkIndex & 63);
+		DirtyRect& dirtyRect = m_Rects[chunkIndex];
+		if (word & bit)
+		{
+			dirtyRect.minX = std::min(dirtyRect.minX, rect.minX);
+			dirtyRect.minY = std::min(dirtyRect.minY, rect.minY);
+			dirtyRect.maxX = std::max(dirtyRect.maxX, rect.maxX);
+			dirtyRect.maxY = std::max(dirtyRect.maxY, rect.maxY);
+			return;
+		}
+
+		word |= bit;
+		dirtyRect = rect;
+		m_ActiveChunks.push_back(chunkIndex);
+	}
+
+	// Only meaningful for chunks in the set
+	const DirtyRect& GetRect(int chunkIndex) const { return m_Rects[chunkIndex]; }
+
+	void Unmark(int chunkIndex)
+	{
+		uint64_t& word = m_Bits[chunkIndex >> 6];
+		const uint64_t bit = uint64_t{ 1 } << (chunkIndex & 63);
+		if (!(word & bit)) return;
+
+		word &= ~bit;
+		m_ActiveChunks.erase(std::find(m_ActiveChunks.begin(), m_ActiveChunks.end(), chunkIndex));
+	}
+
+	void Clear()
+	{
+		// only touch the words that can have bits set
+		for (int chunkIndex : m_ActiveChunks)
+		{
+			m_Bits[chunkIndex >> 6] = 0;
+		}
+		m_ActiveChunks.clear();
+	}
+
+	bool Any() const { return !m_ActiveChunks.empty(); }
+
+	// Chunk indices in the set, in marking order unless sorted by the caller
+	std::vector<int>& GetActiveChunks() { return m_ActiveChunks; }
+	const std::vector<int>& GetActiveChunks() const { return m_ActiveChunks; }
+
+private:
+	std::vector<uint64_t> m_Bits{};
+	std::vector<DirtyRect> m_Rects{};
+	std::vector<int> m_ActiveChunks{};
+};
+
+#endif // !DIRTYCHUNKSET_H
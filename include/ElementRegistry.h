@@ -3,34 +3,84 @@
 
 #include "Components.h"
 #include <unordered_map>
+#include <vector>
 #include <string>
 #include <glm/glm.hpp>
 #include <variant>
+#include <cassert>
+#include <limits>
+#include <tuple>
+#include <mutex>
+#include <shared_mutex>
+#include "Random.h"
+#include <array>
+#include <type_traits>
 
 
 // I erase the type so we can store all kinds of components
 using Component = std::variant<SolidComp, LiquidComp, GasComp, GravityComp, SpreadableComp, SpreadingComp, LifeTimeComp>;
 
+// Every component type gets a bit, its index in the Component variant
+using ComponentMask = uint32_t;
+static_assert(std::variant_size_v<Component> <= sizeof(ComponentMask) * 8, "Too many component types for ComponentMask!");
+
+template <typename ComponentType, size_t Index = 0>
+constexpr size_t GetComponentIndex()
+{
+	static_assert(Index < std::variant_size_v<Component>, "Type is not a Component!");
+	if constexpr (std::is_same_v<std::variant_alternative_t<Index, Component>, ComponentType>)
+		return Index;
+	else
+		return GetComponentIndex<ComponentType, Index + 1>();
+}
+
+template <typename ComponentType>
+constexpr ComponentMask ComponentBit = ComponentMask{ 1 } << GetComponentIndex<ComponentType>();
+
+using ElementTypeID = uint8_t;			// Small index of an element definition, assigned by the registry
+constexpr ElementTypeID EMPTY_TYPE = 0;	// 0 is never handed out so it can stand for "no element"
+constexpr ElementTypeID BORDER_TYPE = std::numeric_limits<ElementTypeID>::max(); // type of the grid padding, has no components
+constexpr size_t MAX_ELEMENT_TYPES = size_t{ std::numeric_limits<ElementTypeID>::max() } + 1;
+
 struct ElementDefinition
 {
 	std::string name{};
 	uint32_t color{};
 	std::unordered_map<std::string, Component> components{};
+	// filled in by the registry when the definition is added
+	ElementTypeID typeID{ EMPTY_TYPE };
+	ComponentMask componentMask{};
 };
 
-using ElementID = uint32_t;			// Unique identifier for each element
+// One dense parameter table per component type, indexed by ElementTypeID
+template <typename Variant>
+struct ComponentTables;
+
+template <typename... ComponentTypes>
+struct ComponentTables<std::variant<ComponentTypes...>>
+{
+	using Type = std::tuple<std::vector<ComponentTypes>...>;
+};
+
+// Generational handle: slot index in the low bits, generation of that slot in the high bits.
+// Slots are recycled, the generation is bumped on every release so stale handles can be detected.
+using ElementID = uint32_t;
+constexpr uint32_t ELEMENT_INDEX_BITS = 24;
+constexpr uint32_t ELEMENT_INDEX_MASK = (uint32_t{ 1 } << ELEMENT_INDEX_BITS) - 1;
+constexpr uint32_t MAX_ELEMENT_SLOTS = ELEMENT_INDEX_MASK; // the last index is never used, so BORDER_CELL is never a live handle
 constexpr ElementID EMPTY_CELL = 0;	// 0 will be used to indicate "empty" elements
+constexpr ElementID BORDER_CELL = std::numeric_limits<ElementID>::max(); // padding around the grid, never empty and has no data
+
+constexpr uint32_t GetElementIndex(ElementID id) { return id & ELEMENT_INDEX_MASK; }
+constexpr uint8_t GetElementGeneration(ElementID id) { return static_cast<uint8_t>(id >> ELEMENT_INDEX_BITS); }
+constexpr ElementID MakeElementID(uint32_t index, uint8_t generation) { return (ElementID{ generation } << ELEMENT_INDEX_BITS) | index; }
 
+// Cold per element state, the hot state (type, tint, flags) is packed into the grid's Cell words
 struct Element
 {
-	const ElementDefinition* definition{}; // Pointer to the shared particle type definition
 	glm::vec2 velocity{};
-	bool hasMoved{};
-	bool hasSpread{};
 	int spreadCount{};
-	int8_t tint{}; // Tint adjustment (-128 to 127)
 	float lifeTime{ -1.f };
-	bool toBeDestroyed{};
 };
 
 class ElementRegistry final
@@ -43,18 +93,58 @@ public:
 	ElementRegistry(ElementRegistry&& other) = delete;
 	ElementRegistry& operator=(ElementRegistry&& other) = delete;
 public:
-	ElementID AddElement(const std::string& elementTypeName);
+	void Reserve(size_t elementCount);
+	ElementID AddElement(ElementTypeID typeID, CellRandom& random);
 	void RemoveElement(ElementID id);
-	Element* GetElementData(ElementID id);
+	inline bool IsValid(ElementID id) const;
+	inline Element* GetElementData(ElementID id);
+	size_t GetElementCount() const { return m_ElementData.size() - 1 - m_FreeElementSlots.size(); };
+	size_t GetSlotCount() const { return m_ElementData.size() - 1; };
 	const ElementDefinition* GetElementType(const std::string& name) const;
+	const ElementDefinition* GetElementType(ElementTypeID typeID) const { return m_ElementTypesByID[typeID]; };
+	// type ids in use are below this (including EMPTY_TYPE)
+	size_t GetElementTypeCount() const { return m_ElementTypesByID.size(); };
+	ComponentMask GetComponentMask(ElementTypeID typeID) const { return m_ComponentMasks[typeID]; };
 	const std::unordered_map<std::string, ElementDefinition>& GetElementTypes() const;
 	void AddElementType(const ElementDefinition& definition);
+	// Types are only added on the simulation thread, other threads hold this while they read them
+	std::shared_lock<std::shared_mutex> LockElementTypes() const { return std::shared_lock{ m_TypesMutex }; };
+
+	// Only valid if the definition's componentMask has ComponentBit<ComponentType> set
+	template <typename ComponentType>
+	const ComponentType& GetComponent(ElementTypeID typeID) const
+	{
+		return std::get<std::vector<ComponentType>>(m_ComponentTables)[typeID];
+	}
 private:
-	// map unique element ids to unique element data
-	std::unordered_map<ElementID, Element> m_ElementData{};
+	// dense slot array indexed by the element id's index (slot 0 is reserved for EMPTY_CELL)
+	std::vector<Element> m_ElementData{};
+	// current generation of every slot, kept apart so the slot array stays tightly packed
+	std::vector<uint8_t> m_SlotGenerations{};
+	// indices of released slots, reused before the slot array grows
+	std::vector<uint32_t> m_FreeElementSlots{};
+	// elements can expire on any thread during a parallel update
+	std::mutex m_SlotMutex{};
+	mutable std::shared_mutex m_TypesMutex{};
 	// flyweight pattern for element definitions
 	std::unordered_map<std::string, ElementDefinition> m_ElementTypes{};
-	ElementID m_NextElementID = 1; // start IDs from 1 (0 for EMPTY_CELL)
+	// definitions by type id, slot 0 (EMPTY_TYPE) stays nullptr
+	std::vector<const ElementDefinition*> m_ElementTypesByID{ nullptr };
+	// component masks for every possible type id, so any cell's type can be tested without a range check
+	std::array<ComponentMask, MAX_ELEMENT_TYPES> m_ComponentMasks{};
+	ComponentTables<Component>::Type m_ComponentTables{};
 };
 
+inline bool ElementRegistry::IsValid(ElementID id) const
+{
+	const uint32_t index = GetElementIndex(id);
+	return index != 0 && index < m_ElementData.size() && m_SlotGenerations[index] == GetElementGeneration(id);
+}
+
+inline Element* ElementRegistry::GetElementData(ElementID id)
+{
+	assert(IsValid(id) && "Invalid or stale element id!");
+	return &m_ElementData[GetElementIndex(id)];
+}
+
 #endif // !ELEMENTREGISTRY_H
@@ -2,9 +2,32 @@
 #define GRID_H
 
 #include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <array>
+#include <optional>
 #include "Window.h"
 #include <glm/glm.hpp>
 #include "ElementRegistry.h"
+#include "Cell.h"
+#include "DirtyChunkSet.h"
+#include "AlignedAllocator.h"
+#include "Random.h"
+#include "GridSnapshot.h"
+#include "GridCommand.h"
+#include "SPMCQueue.h"
+
+enum class GridLayout : uint8_t
+{
+	// one row-major allocation surrounded by a border, every chunk always exists
+	RowMajor,
+	// every chunk in its own contiguous block (chunk-major), so a chunk update touches a single block
+	Tiled,
+	// chunk sized blocks allocated on first write and released again once empty,
+	// for worlds far larger than what is ever filled
+	Sparse
+};
 
 struct GridInfo
 {
@@ -12,6 +35,29 @@ struct GridInfo
 	int rows{};
 	int columns{};
 	int cellSize{};
+	GridLayout layout{ GridLayout::RowMajor };
+	// every random choice in the simulation follows from this
+	uint64_t seed{};
+};
+
+// One band of a world split over several processes (see ShardedWorld).
+// Only the chunk rows in [firstChunkX, lastChunkX] are updated, the rows around them mirror the neighbouring bands.
+struct GridBand
+{
+	int firstChunkX{};
+	int lastChunkX{};
+	// row of the whole world local row 0 is, chunk row parity and random numbers follow the whole world
+	int worldFirstRow{};
+	int worldNumChunksX{};
+	// called after the chunk rows of each parity are updated, to exchange the rows around the band
+	std::function<void()> onRowPhaseDone{};
+};
+
+// A cell along with its element data, how bands hand rows to each other
+struct CellRecord
+{
+	Cell cell{};
+	Element element{};
 };
 
 class Grid final
@@ -38,9 +84,12 @@ public:
 	void RenderElements(Window* window) const;
 	void RenderBrush(Window* window) const;
 
-	void AddElementBrushed(int x, int y, const std::string& elementTypeName, bool override, float spawnChance = 1.0f);
+	void AddElementBrushed(int x, int y, int brushSize, const std::string& elementTypeName, bool override, float spawnChance = 1.0f);
 	void AddElementAt(int x, int y, const std::string& elementTypeName);
-	void RemoveElementBrushed(int x, int y);
+	void RemoveElementBrushed(int x, int y, int brushSize);
+	// Every cell under any stamp of the stroke gets edited once, overlapping stamps only combine their spawn chance
+	void AddElementsBrushed(const std::vector<glm::ivec2>& stamps, int brushSize, const std::string& elementTypeName, bool override, float spawnChance = 1.0f);
+	void RemoveElementsBrushed(const std::vector<glm::ivec2>& stamps, int brushSize);
 	void RemoveElementAt(int x, int y);
 	inline glm::ivec2 ConvertScreenToGrid(const glm::ivec2& screenPos) const;
 
@@ -50,12 +99,25 @@ public:
 	int GetNumChunksX() const { return m_NumChunksX; };
 	int GetNumChunksY() const { return m_NumChunksY; };
 	int GetChunkSize() const { return m_ChunkSize; };
+	int GetChunkIndex(int chunkX, int chunkY) const { return chunkX * m_NumChunksY + chunkY; };
+	DirtyRect GetChunkBounds(int chunkX, int chunkY) const;
+	bool IsChunkAllocated(int chunkIndex) const;
+	int GetAllocatedChunkCount() const;
+	// Number of cells holding each element type, indexed by type id
+	std::vector<int> CountElementTypes() const;
 
 	bool IsChunkDirty(int chunkX, int chunkY);
 	void MarkChunkAsDirty(int x, int y);
 	void UnmarkChunkAsDirty(int x, int y);
 	void ResetDirtyChunks();
 
+	inline int GetCellIndex(int x, int y) const;
+	inline int GetChunkCellIndex(int x, int y) const;
+	inline Cell GetCell(int x, int y) const;
+	inline Cell GetCell(const glm::ivec2& pos) const;
+	inline void SetCell(int x, int y, Cell cell);
+	// The color plane follows every move and edit on its own, a cell that changes type in place has to call this
+	void RecolorCell(int x, int y);
 	inline ElementID GetElementID(int x, int y) const;
 	inline ElementID GetElementID(const glm::ivec2& pos) const;
 	inline Element* GetElementData(int x, int y) const;
@@ -64,26 +126,156 @@ public:
 	inline bool IsWithinBounds(const glm::ivec2& pos) const;
 	inline bool IsEmpty(int x, int y) const;
 	inline bool IsEmpty(const glm::ivec2& pos) const;
+	// Bit i set if cell (x, minY + i) is occupied, for a span of a row within one chunk
+	inline uint64_t FindOccupiedCells(int x, int minY, int maxY) const;
 	inline bool IsEvenFrame() const;
+	// low byte of the tick count, what update stamps are compared against
+	uint8_t GetFrameCounter() const { return static_cast<uint8_t>(m_TickCount); };
+	uint32_t GetTickCount() const { return m_TickCount; };
+	// Random numbers for the simulation of a cell during this tick
+	CellRandom GetRandom(int x, int y) const { return { m_GridInfo.seed, m_TickCount, SIMULATION_RANDOM_STREAM, x + m_WorldFirstRow, y }; };
 	const ElementRegistry* GetElementRegistry() const { return m_pElementRegistry.get(); };
+	// Every grid keeps its own time step, so several worlds can run side by side
+	float GetFixedTimeStep() const { return m_FixedTimeStep; };
+	void SetFixedTimeStep(float fixedTimeStep) { m_FixedTimeStep = fixedTimeStep; };
+
+	void SetUpdateScheduling(UpdateScheduling scheduling);
+	UpdateScheduling GetUpdateScheduling() const { return m_UpdateScheduling; };
+	bool IsParallelUpdate() const { return m_UpdateScheduling != UpdateScheduling::Serial; };
+	// Makes this grid a band of a sharded world, the update then goes by chunk row parity like the checkerboard
+	void SetBand(GridBand band);
+	const GridBand* GetBand() const { return m_Band ? &*m_Band : nullptr; };
+	// Whole rows with their element data, rowCount * columns records.
+	// Importing only touches cells that differ, and wakes the chunks around them.
+	void ExportRows(int firstRow, int rowCount, CellRecord* pRecords) const;
+	void ImportRows(int firstRow, int rowCount, const CellRecord* pRecords);
+	// Marks for the next update in a chunk row, one rect per chunk column in rows of the whole world
+	// (minX > maxX for chunks without any). Exporting takes them out of this grid,
+	// a band hands the ones it made in its halo to the band owning those rows.
+	void ExportDirtyRects(int chunkX, DirtyRect* pRects);
+	void ImportDirtyRects(const DirtyRect* pRects);
+	// How far a single movement step (velocity move or dispersion) may go from its cell
+	int GetMaxReach() const;
+	// Parallel for over the given chunks on the job system.
+	// The chunks must not share any cells they touch, unless isClaimingCells makes every move claim its cells
+	void UpdateChunksInParallel(const std::vector<int>& chunkIndices, const std::function<void(int)>& updateChunk, bool isClaimingCells = false);
+
+	// Optimistic parallel update: the updating thread holds its element's cell and claims any other cell it changes.
+	// Claiming fails when the cell isn't the expected value anymore (or another thread has it), the caller backs off then.
+	// Outside of that update these always succeed.
+	bool HoldElement(int x, int y, Cell expected);
+	void ReleaseHeldElement();
+	bool ClaimCell(int x, int y, Cell expected);
+	void ReleaseCell(int x, int y);
 
 	void MoveElement(int x, int y, int newX, int newY);
-	void SwapElements(int x, int y, int newX, int newY);
+	// newCell is what the caller saw at the destination when it decided on the move.
+	// Returns false if a cell was lost to another thread in the optimistic update,
+	// or the destination isn't newCell anymore, nothing moved then
+	bool SwapElements(int x, int y, int newX, int newY, Cell newCell);
 	void ClearGrid();
-	mutable std::vector<std::vector<bool>> m_CurrentDirtyChunks;
-	mutable std::vector<std::vector<bool>> m_NextDirtyChunks;
+
+	// Input and UI never change the grid directly, so the simulation can run on another thread.
+	// Only the main thread queues, the simulation drains everything at the start of its step
+	void QueueCommand(GridCommand&& command);
+	void ApplyCommands();
+	// Copies the changed parts of the grid into the back snapshot and hands it to the renderer
+	void PublishSnapshot();
+	// chunks changed during the last update (processed this tick) and chunks marked for the next one
+	DirtyChunkSet m_CurrentDirtyChunks;
+	DirtyChunkSet m_NextDirtyChunks;
 private:
 	GridInfo m_GridInfo{};
+	float m_FixedTimeStep{};
 
-	const int m_ChunkSize{ 32 };
+	inline int GetWritableCellIndex(int x, int y);
+	// Cell words are accessed atomically (plain loads and stores on x86 and ARM),
+	// the optimistic parallel update reads and claims cells other threads work on
+	inline Cell LoadCell(int index) const;
+	inline void StoreCell(int index, Cell cell);
+	bool TryClaimCell(int index, Cell expected);
+	bool SwapClaimedCells(int index, int newIndex, Cell newCell);
+	void AddElementAt(int x, int y, const std::string& elementTypeName, CellRandom& random);
+	void AllocateChunk(int chunkIndex);
+	void ReleaseChunk(int chunkIndex);
+	void ReleaseEmptyChunks();
+	void PreallocateChunkNeighbours();
 
+	static constexpr int m_ChunkSize{ 32 };
+	static constexpr int m_CellsPerChunk{ m_ChunkSize * m_ChunkSize };
+	// ring of BORDER_CELLs around the grid so direct neighbours never need a bounds check
+	const int m_BorderSize{ 1 };
+	int m_RowStride{};
 
 	int m_NumChunksX{};
 	int m_NumChunksY{};
 
-	std::vector<std::vector<ElementID>> m_Elements{};
+	// all cells in one allocation, row-major including the border or in chunk blocks, see GetCellIndex
+	// hot packed cell state, read by every neighbour check
+	std::vector<Cell, AlignedAllocator<Cell>> m_Cells{};
+	// handles to the cold element data in the registry, moved along with m_Cells
+	std::vector<ElementID, AlignedAllocator<ElementID>> m_Elements{};
+	// texture color of every cell (base color plus tint), moved along with m_Cells,
+	// so publishing a snapshot copies finished pixels instead of converting every cell again
+	std::vector<uint32_t, AlignedAllocator<uint32_t>> m_Colors{};
+	// base color of every element type, BACKGROUND_COLOR for EMPTY_TYPE
+	std::array<uint32_t, MAX_ELEMENT_TYPES> m_TypeColors{};
+	// types m_TypeColors holds, no cell can have a type past it yet
+	size_t m_TypeColorCount{};
+
+	// Tiled and Sparse layouts start with a shared empty block and a border block for out of bounds reads.
+	// Tiled stores chunk i in block FIRST_CHUNK_BLOCK + i, Sparse keeps the block of every chunk
+	// and the chunk owning every block, unallocated chunks read from the empty block.
+	static constexpr int EMPTY_BLOCK{ 0 };
+	static constexpr int BORDER_BLOCK{ 1 };
+	static constexpr int FIRST_CHUNK_BLOCK{ 2 };
+	std::vector<int> m_ChunkBlocks{};
+	std::vector<int> m_BlockChunks{};
+	// empty chunks allocated up front for a parallel update, released again if nothing moved into them
+	std::vector<int> m_PreallocatedChunks{};
+
+	// Parallel update: every thread marks into its own set, merged into m_NextDirtyChunks afterwards
+	UpdateScheduling m_UpdateScheduling{ UpdateScheduling::Serial };
+	std::vector<DirtyChunkSet> m_ThreadDirtyChunks{};
+	// only set while the chunks of an optimistic update run
+	bool m_IsClaimingCells{};
+	// per thread during the update, added up in m_ClaimStats afterwards
+	struct alignas(64) ThreadClaimStats
+	{
+		ClaimStats stats{};
+	};
+	std::vector<ThreadClaimStats> m_ThreadClaimStats{};
+	ClaimStats m_ClaimStats{};
 	std::unique_ptr<ElementRegistry> m_pElementRegistry{};
 
+	std::optional<GridBand> m_Band{};
+	int m_WorldFirstRow{};
+
+	void ApplyCommand(const GridCommand& command);
+	// Picks up new or changed element types, recoloring the whole plane if an existing color changed
+	void RefreshTypeColors();
+	// Counts how many stamps cover every cell of the stroke into m_StrokeCoverage, returns the clipped bounds
+	DirtyRect RasterizeStroke(const std::vector<glm::ivec2>& stamps, int brushSize);
+
+	static constexpr size_t COMMAND_QUEUE_CAPACITY{ 1024 };
+	SPMCQueue<GridCommand, COMMAND_QUEUE_CAPACITY> m_QueuedCommands{};
+	// reused between steps
+	std::vector<GridCommand> m_DrainedCommands{};
+	std::vector<uint8_t> m_StrokeCoverage{};
+
+	std::array<GridSnapshot, 2> m_Snapshots{};
+	int m_FrontSnapshot{};
+	uint64_t m_SnapshotVersion{};
+	uint32_t m_PublishedTickCount{};
+	// changes since the last snapshot that got swapped to the front, a failed swap keeps them for the next one
+	DirtyChunkSet m_UnpublishedChunks;
+	// held by the renderer while it reads the front snapshot, and by the simulation to swap them
+	mutable std::mutex m_SnapshotMutex{};
+	// anything but the first version, so the first frame uploads the empty grid
+	mutable uint64_t m_UploadedSnapshotVersion{ UINT64_MAX };
+	// created on the first render, holds the pixels of the last uploaded snapshot
+	mutable SDL_Texture* m_pGridTexture{};
+
 	// Brush Settings
 	int m_BrushSize{ 4 };
 	glm::vec3 m_BrushColor{ 0.f, 100.f, 0.f };
@@ -96,7 +288,10 @@ private:
 	mutable std::string m_SelectedElement{};
 	bool m_MouseIsInGrid{};
 
-	uint8_t m_FrameCounter{};
+	uint32_t m_TickCount{};
+	// every stroke gets its own random stream, so repeated strokes over a cell in one tick roll differently.
+	// Strokes are counted rather than cells, so every band of a split world counts the same
+	uint32_t m_EditCount{};
 };
 
 #endif // !GRID_H
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef GRIDCOMMAND_H
+#define GRIDCOMMAND_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ElementRegistry.h"
+
+// How the chunks of a tick are spread over threads
+enum class UpdateScheduling : uint8_t
+{
+	// one chunk after the other
+	Serial,
+	// 2x2 checkerboard phases, chunks of a phase are too far apart to reach each other
+	Checkerboard,
+	// every active chunk at once, cells that threads fight over are claimed with a CAS (experimental)
+	Optimistic
+};
+
+// A change to the grid coming from input or the UI, applied by the simulation at the start of its next step
+struct GridCommand
+{
+	enum class Type : uint8_t
+	{
+		Brush,
+		Erase,
+		Clear,
+		DefineElementType,
+		SetUpdateScheduling
+	};
+
+	Type type{};
+	// brush stamp centres of a stroke, everything the mouse passed over in one frame
+	std::vector<glm::ivec2> stamps{};
+	int brushSize{};
+	bool override{};
+	float spawnChance{ 1.f };
+	std::string elementTypeName{};
+	ElementDefinition definition{};
+	UpdateScheduling scheduling{};
+
+	// Strokes with the same brush can be stamped as one
+	bool CanMergeWith(const GridCommand& other) const
+	{
+		if (type != other.type || brushSize != other.brushSize) return false;
+		if (type == Type::Erase) return true;
+		return type == Type::Brush && override == other.override && spawnChance == other.spawnChance && elementTypeName == other.elementTypeName;
+	}
+};
+
+#endif // !GRIDCOMMAND_H
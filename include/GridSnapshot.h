@@ -0,0 +1,42 @@
+#ifndef GRIDSNAPSHOT_H
+#define GRIDSNAPSHOT_H
+
+#include <vector>
+#include <cstdint>
+#include "Cell.h"
+#include "DirtyChunkSet.h"
+
+// what empty cells are drawn with
+constexpr uint32_t BACKGROUND_COLOR{ 0x1A1A1A };
+
+// Cell claims of the optimistic parallel update during one tick
+struct ClaimStats
+{
+	uint32_t claims{};
+	// claims lost to another thread, the element waits for the next tick then
+	uint32_t conflicts{};
+};
+
+// Read-only copy of the grid that rendering works from, published by the simulation after every step.
+// The grid keeps two of these: the front one is read by the renderer while the back one gets filled.
+struct GridSnapshot
+{
+	// rows * columns, row-major without the border
+	std::vector<Cell> cells{};
+	// rows * columns texture pixels of the cells, copied from the grid's color plane
+	std::vector<uint32_t> pixels{};
+	// the parts of chunks that changed since the previous snapshot was published
+	std::vector<DirtyRect> dirtyRects{};
+	// chunks with their own block in a sparse grid
+	int allocatedChunks{};
+	// claims of the last update, all zero unless it was optimistic
+	ClaimStats claimStats{};
+	// bumped for every published snapshot, so unchanged ones aren't uploaded again
+	uint64_t version{};
+	// simulation side only: chunks changed since this buffer was last filled
+	DirtyChunkSet staleChunks{};
+	// parts of chunks changed since the snapshot the renderer last uploaded, all it has to upload for this one
+	DirtyChunkSet uploadChunks{};
+};
+
+#endif // !GRIDSNAPSHOT_H
@@ -16,6 +16,8 @@ public:
 	virtual bool IsActive() const = 0;
 	virtual float GetFixedTimeStep() const = 0;
 	virtual void SetFixedTimeStep(float fixedTimeStep) = 0;
+	// Run the fixed steps on a dedicated thread instead of from FixedUpdate
+	virtual void SetThreaded(bool isThreaded) = 0;
 };
 
 #endif // !ISANDSIMULATION_H
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Number of submitted jobs that haven't finished yet
+using JobCounter = std::atomic<int>;
+
+// Work-stealing scheduler shared by the simulation and rendering.
+// Every worker pushes and pops its own jobs at the back of its deque and steals from the front of the others,
+// so a thread stuck with a heavy job (a chunk full of water) gets its remaining work taken over.
+// Threads that aren't workers (main, simulation) each get one of a few extra deques and help out while they wait.
+class JobSystem final
+{
+public:
+	using Job = std::function<void(int threadIndex)>;
+
+	static JobSystem& GetInstance()
+	{
+		static JobSystem instance;
+		return instance;
+	}
+
+	~JobSystem();
+
+	JobSystem(const JobSystem& other) = delete;
+	JobSystem& operator=(const JobSystem& other) = delete;
+	JobSystem(JobSystem&& other) = delete;
+	JobSystem& operator=(JobSystem&& other) = delete;
+public:
+	// Workers plus the slots for other threads, thread indices passed to jobs are below this
+	int GetThreadCount() const { return static_cast<int>(m_Queues.size()); };
+	// Index of the calling thread, threads that aren't workers get theirs the first time they ask
+	int GetThreadIndex();
+
+	// The counter has to be incremented for the job before it is submitted
+	void Submit(Job job, JobCounter& counter);
+	// Runs queued jobs on the calling thread until the counter reaches 0
+	void Wait(const JobCounter& counter);
+
+	// Calls func(index, threadIndex) for every index in [0, count), in jobs of batchSize indices,
+	// and returns once all of them are done
+	void ParallelFor(int count, int batchSize, const std::function<void(int, int)>& func);
+private:
+	JobSystem();
+
+	// main thread, simulation thread and some headroom
+	static constexpr int MAX_OUTSIDE_THREADS{ 4 };
+
+	struct QueuedJob
+	{
+		Job job{};
+		JobCounter* pCounter{};
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex{};
+		std::deque<QueuedJob> jobs{};
+	};
+
+	void WorkerLoop(int threadIndex);
+	void Push(int threadIndex, QueuedJob&& queuedJob);
+	bool TryRunJob(int threadIndex);
+
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues{};
+	std::vector<std::thread> m_Workers{};
+	std::atomic<int> m_OutsideThreadCount{};
+
+	std::atomic<int> m_QueuedJobs{};
+	std::mutex m_SleepMutex{};
+	std::condition_variable m_JobAvailable{};
+	bool m_IsStopping{};
+};
+
+#endif // !JOBSYSTEM_H
@@ -0,0 +1,99 @@
+#ifndef MARGOLUSSANDSIMULATION_H
+#define MARGOLUSSANDSIMULATION_H
+
+#include "ISandSimulation.h"
+#include "Grid.h"
+#include "GridCommand.h"
+#include "SPMCQueue.h"
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+// Block cellular automaton for the Sand/Water/Smoke/Wall element set.
+// Every step cuts the world into 2x2 blocks, shifted by one cell on every other step (Margolus neighbourhood),
+// and replaces each block by a precomputed transition of its contents. Blocks of a step never overlap,
+// so the order they are updated in doesn't matter and they are split over the job system freely.
+class MargolusSandSimulation final : public ISandSimulation
+{
+public:
+	MargolusSandSimulation(const GridInfo& gridInfo, Window* window);
+	~MargolusSandSimulation() override;
+
+	MargolusSandSimulation(const MargolusSandSimulation& other) = delete;
+	MargolusSandSimulation& operator=(const MargolusSandSimulation& other) = delete;
+	MargolusSandSimulation(MargolusSandSimulation&& other) = delete;
+	MargolusSandSimulation& operator=(MargolusSandSimulation&& other) = delete;
+
+	void Update() override;
+	void FixedUpdate() override;
+	void Render() const override;
+
+	bool IsActive() const override;
+	float GetFixedTimeStep() const override;
+	void SetFixedTimeStep(float fixedTimeStep) override;
+	void SetThreaded(bool isThreaded) override;
+private:
+	enum Material : uint8_t
+	{
+		Empty,
+		Sand,
+		Water,
+		Smoke,
+		Wall,
+		MaterialCount
+	};
+
+	// every arrangement of materials in a 2x2 block
+	static constexpr int BLOCK_STATES{ MaterialCount * MaterialCount * MaterialCount * MaterialCount };
+	// bit 0 mirrors the block (no left/right bias), bit 1 lets the smoke in it dissipate
+	static constexpr int TRANSITION_VARIANTS{ 4 };
+	// Resulting block packed one material per byte: top left, top right, bottom left, bottom right
+	using TransitionTable = std::array<std::array<uint32_t, BLOCK_STATES>, TRANSITION_VARIANTS>;
+
+	static const TransitionTable& GetTransitionTable();
+	static uint32_t ResolveBlock(std::array<uint8_t, 4> block, bool isMirrored, bool isDissipating);
+	static Material GetMaterial(const std::string& elementTypeName);
+
+	GridInfo m_GridInfo{};
+	Window* m_pWindow{};
+	// rows + 2 by columns + 2, the outer ring is wall so blocks at the edges need no bounds checks
+	int m_PaddedColumns{};
+	std::vector<uint8_t> m_Cells{};
+	uint32_t m_TickCount{};
+
+	std::atomic<bool> m_IsSimulating{ true };
+	std::atomic<bool> m_IsStepRequested{};
+	float m_FixedTimeStep{};
+
+	// Input, picked in the UI drawn by Render
+	mutable Material m_SelectedMaterial{ Sand };
+	mutable bool m_IsClearRequested{};
+	int m_BrushSize{ 5 };
+	glm::ivec2 m_PreviousMousePos{ -1, -1 };
+	SPMCQueue<GridCommand, 256> m_QueuedCommands{};
+
+	// Last published step, copied out under the lock so the renderer never sees a step halfway
+	std::vector<uint8_t> m_Snapshot{};
+	uint64_t m_SnapshotVersion{};
+	mutable std::mutex m_SnapshotMutex{};
+	mutable SDL_Texture* m_pTexture{};
+	mutable uint64_t m_UploadedSnapshotVersion{ UINT64_MAX };
+
+	// declared last so it is stopped before the cells go away
+	std::jthread m_SimulationThread{};
+
+	void Init() override;
+	void Step();
+	void Tick();
+	void ApplyCommands();
+	void Stamp(const std::vector<glm::ivec2>& stamps, int brushSize, Material material, bool override);
+	void PublishSnapshot();
+	void SimulationLoop(std::stop_token stopToken);
+
+	glm::ivec2 ConvertScreenToGrid(const glm::ivec2& screenPos) const;
+};
+
+#endif // !MARGOLUSSANDSIMULATION_H
@@ -0,0 +1,65 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Counter-based random numbers: every draw is a hash of (seed, tick, stream, x, y, draw index).
+// There is no shared state, so the same seed gives the same simulation whatever thread or order cells are updated in.
+constexpr uint64_t MixRandomBits(uint64_t value)
+{
+	// MurmurHash3 64-bit finalizer
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+// Streams keep different users of the same cell and tick apart
+constexpr uint32_t SIMULATION_RANDOM_STREAM{ 0 };
+// edits use this plus their edit index
+constexpr uint32_t EDIT_RANDOM_STREAM{ 1 };
+
+class CellRandom final
+{
+public:
+	CellRandom(uint64_t seed, uint32_t tick, uint32_t stream, int x, int y)
+		: m_Key{ MixRandomBits(MixRandomBits(seed ^ ((uint64_t{ tick } << 32) | stream))
+			^ ((uint64_t{ static_cast<uint32_t>(x) } << 32) | static_cast<uint32_t>(y))) }
+	{
+	}
+
+	uint32_t Next()
+	{
+		return static_cast<uint32_t>(MixRandomBits(m_Key + ++m_DrawIndex * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	// [0, 1)
+	float NextFloat()
+	{
+		return static_cast<float>(Next() >> 8) * (1.f / 16777216.f);
+	}
+
+	// [min, max)
+	float NextFloat(float min, float max)
+	{
+		return min + NextFloat() * (max - min);
+	}
+
+	// [min, max]
+	int NextInt(int min, int max)
+	{
+		return min + static_cast<int>((static_cast<uint64_t>(Next()) * static_cast<uint64_t>(max - min + 1)) >> 32);
+	}
+
+	bool NextBool()
+	{
+		return Next() & 1;
+	}
+private:
+	uint64_t m_Key{};
+	uint32_t m_DrawIndex{};
+};
+
+#endif // !RANDOM_H
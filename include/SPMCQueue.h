@@ -0,0 +1,95 @@
+#ifndef SPMCQUEUE_H
+#define SPMCQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free queue with one producer and any number of consumers.
+// Every slot carries a sequence number telling whose turn it is: the producer may fill it when it equals the
+// write position, a consumer may take it when it equals the read position + 1.
+// Consumers claim a read position with a CAS, so a consumer never waits on another one.
+template <typename T, size_t Capacity>
+class SPMCQueue final
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two!");
+public:
+	SPMCQueue()
+		: m_Slots{ std::make_unique<Slot[]>(Capacity) }
+	{
+		for (size_t i{}; i < Capacity; ++i)
+		{
+			m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~SPMCQueue() = default;
+	SPMCQueue(const SPMCQueue& other) = delete;
+	SPMCQueue& operator=(const SPMCQueue& other) = delete;
+	SPMCQueue(SPMCQueue&& other) = delete;
+	SPMCQueue& operator=(SPMCQueue&& other) = delete;
+
+	// Only ever called from the producing thread, returns false when the queue is full
+	bool TryPush(T&& value)
+	{
+		Slot& slot = m_Slots[m_Tail & INDEX_MASK];
+
+		// The consumer of the previous lap hasn't taken this slot yet
+		if (slot.sequence.load(std::memory_order_acquire) != m_Tail) return false;
+
+		slot.value = std::move(value);
+		slot.sequence.store(m_Tail + 1, std::memory_order_release);
+		++m_Tail;
+		return true;
+	}
+
+	// Returns false when the queue is empty
+	bool TryPop(T& value)
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Slot& slot = m_Slots[head & INDEX_MASK];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head + 1);
+
+			if (difference == 0)
+			{
+				if (m_Head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+				{
+					value = std::move(slot.value);
+					// Hand the slot back to the producer for its next lap
+					slot.sequence.store(head + Capacity, std::memory_order_release);
+					return true;
+				}
+				// head got reloaded by the failed exchange
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				// Another consumer took this one
+				head = m_Head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	static constexpr size_t INDEX_MASK{ Capacity - 1 };
+
+	struct alignas(64) Slot
+	{
+		std::atomic<size_t> sequence{};
+		T value{};
+	};
+
+	std::unique_ptr<Slot[]> m_Slots;
+	// Consumers and the producer write different lines
+	alignas(64) std::atomic<size_t> m_Head{};
+	alignas(64) size_t m_Tail{};
+};
+
+#endif // !SPMCQUEUE_H
@@ -0,0 +1,54 @@
+#ifndef SHARDEDWORLD_H
+#define SHARDEDWORLD_H
+
+#include "Grid.h"
+#include <cstddef>
+
+struct ShardSettings
+{
+	int bandCount{ 4 };
+	int ticks{ 1000 };
+	int rows{ 1024 };
+	int columns{ 256 };
+	uint64_t seed{};
+	float fixedTimeStep{ 1.f / 60.f };
+};
+
+// One world split into horizontal bands, each simulated by its own process (Linux only).
+// Every band keeps a copy of the chunk row on either side of it (its halo). A tick updates the chunk rows of one
+// parity in every band at the same time, exchanges rows through POSIX shared memory, and does the same for the other parity:
+// the halo rows a band changed go back to the band owning them, then every band publishes its edge chunk rows
+// and refreshes its halo from the ones of its neighbours.
+// Elements never reach further than half a chunk (see Grid::GetMaxReach), so the outer half of an edge row
+// can only have been changed by the neighbour and the inner half only by the band itself.
+class ShardedWorld final
+{
+public:
+	explicit ShardedWorld(const ShardSettings& settings);
+	~ShardedWorld() = default;
+
+	ShardedWorld(const ShardedWorld& other) = delete;
+	ShardedWorld& operator=(const ShardedWorld& other) = delete;
+	ShardedWorld(ShardedWorld&& other) = delete;
+	ShardedWorld& operator=(ShardedWorld&& other) = delete;
+
+	// Starts a process per band, waits for all of them and prints the results.
+	// Returns false if the processes or the shared memory couldn't be set up.
+	bool Run();
+private:
+	ShardSettings m_Settings{};
+	int m_WorldNumChunksX{};
+	// every band but the last, which takes the rows left over
+	int m_BandChunkRows{};
+
+	int GetBandFirstRow(int band) const;
+	int GetBandEndRow(int band) const;
+
+	// Runs in the process of the band, pShared is the mapped shared memory
+	void RunBand(int band, std::byte* pShared) const;
+	// Fills the rows of the band with its part of the world, the same whichever way the world is split
+	void SetupBand(Grid& grid, int band, int haloRows) const;
+	void PrintResults(const std::byte* pShared) const;
+};
+
+#endif // !SHARDEDWORLD_H
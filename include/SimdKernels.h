@@ -0,0 +1,49 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include "Cell.h"
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Instruction sets the hot loops have a version for, every level includes the ones before it
+enum class SimdLevel : uint8_t
+{
+	Scalar,
+	SSE42,
+	AVX2,
+	// AVX-512F and BW
+	AVX512
+};
+
+// The hot loops over cells, in the version for one instruction set.
+// The build targets no instruction set past the compiler's default, every version is compiled for its own
+// and the best one the CPU supports is picked at startup, so one binary runs everywhere.
+struct SimdKernels
+{
+	// See ConvertCellColors
+	void (*convertCellColors)(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels);
+	// Bit i set for every cell pCells[i] that isn't EMPTY_CELL_STATE, count is at most 64
+	uint64_t (*findOccupiedCells)(const Cell* pCells, int count);
+	// True if all count cells are EMPTY_CELL_STATE
+	bool (*areCellsEmpty)(const Cell* pCells, int count);
+	// One row of a round brush stamp: adds a hit, saturating at 255, to every cell of the row within the radius.
+	// Cell i lies (firstOffset + i) cells from the stamp along the row, the row itself rowDistanceSquared away from it
+	void (*addStampCoverage)(uint8_t* pCoverage, int count, int firstOffset, int rowDistanceSquared, float radiusSquared);
+};
+
+// The best level the CPU (and the OS, for the wider registers) supports, found with CPUID once
+SimdLevel GetSupportedSimdLevel();
+// The level the kernels currently run at. Starts out at the supported one,
+// unless the SAND_SIMD environment variable (scalar, sse4.2, avx2 or avx512) asks for a lower one
+SimdLevel GetSimdLevel();
+// Switches the kernels to another level, to benchmark the versions against each other.
+// Levels the CPU doesn't support fall back to the supported one, returns the level that got set
+SimdLevel SetSimdLevel(SimdLevel level);
+
+const char* GetSimdLevelName(SimdLevel level);
+std::optional<SimdLevel> ParseSimdLevel(std::string_view name);
+
+const SimdKernels& GetSimdKernels();
+
+#endif // !SIMDKERNELS_H
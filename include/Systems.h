@@ -3,6 +3,8 @@
 
 #include "Utils.h"
 #include <algorithm>
+#include <array>
+#include <bit>
 
 #define SOUTH glm::ivec2{1, 0}
 #define SOUTH_WEST glm::ivec2{1, -1}
@@ -16,72 +18,89 @@ constexpr static float GRAVITY{ 9.8f };
 
 // these are all systems that are applied on the components of the elements
 template <typename ComponentType>
-bool HasComponent(const Element* element, const std::string& componentName)
+bool HasComponent(Cell cell, const ElementRegistry* registry)
 {
-    return element && element->definition->components.count(componentName);
+    return registry->GetComponentMask(GetCellType(cell)) & ComponentBit<ComponentType>;
 }
 
 template <typename ComponentType>
-const ComponentType* TryGetComponent(const Element* element, const std::string& componentName)
+const ComponentType* TryGetComponent(Cell cell, const ElementRegistry* registry)
 {
-    if (!element)
-        return nullptr;
+    if (!HasComponent<ComponentType>(cell, registry))
+        return nullptr; // Return nullptr if the component doesn't exist
 
-    auto it = element->definition->components.find(componentName);
-    if (it != element->definition->components.end())
-    {
-        return std::get_if<ComponentType>(&it->second); // Safely retrieve the component
-    }
-    return nullptr; // Return nullptr if the component doesn't exist
+    return &registry->GetComponent<ComponentType>(GetCellType(cell));
 }
 
-void ProcessSolid(Element* element, int x, int y, Grid& grid);
+void ProcessSolid(int x, int y, Grid& grid, CellRandom& random);
 
-void ProcessLiquid(Element* element, int x, int y, Grid& grid, float dispersionRate);
+void ProcessLiquid(int x, int y, Grid& grid, CellRandom& random, float dispersionRate);
 
-void ProcessGas(Element* element, int x, int y, Grid& grid);
+void ProcessGas(int x, int y, Grid& grid, CellRandom& random);
 
 bool CanSolidReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid);
 bool CanLiquidReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid);
 bool CanGasReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid);
-void UpdateSpreading(Element* element, int x, int y, Grid& grid);
-void UpdateLifetime(Element* element, int x, int y, Grid& grid);
-float GetRandomFloat(float min, float max);
+void UpdateSpreading(Cell cell, int x, int y, Grid& grid, CellRandom& random);
+void UpdateLifetime(Element* element, int x, int y, Grid& grid, CellRandom& random);
+float GetRandomFloat(CellRandom& random, float min, float max);
+
+void UpdateHeldElement(Grid& grid, int x, int y, Cell cell);
 
 void UpdateGridElement(Grid& grid, int x, int y)
 {
+    // The scan that found this cell read it separately, in the optimistic update an element of another thread
+    // can have passed through it since
+    const Cell cell = grid.GetCell(x, y);
+    if (cell == EMPTY_CELL_STATE) return;
+    if (GetCellStamp(cell) == grid.GetFrameCounter()) return;
+
+    // In the optimistic parallel update the thread of a neighbouring chunk can get to this element too,
+    // whoever holds its cell first updates it
+    if (!grid.HoldElement(x, y, cell)) return;
+    UpdateHeldElement(grid, x, y, cell);
+    grid.ReleaseHeldElement();
+}
+
+void UpdateHeldElement(Grid& grid, int x, int y, Cell cell)
+{
+    const ElementRegistry* registry = grid.GetElementRegistry();
     Element* element = grid.GetElementData(x, y);
-    if (element->hasMoved) return;
+    // Every random choice for this element during this tick, the same whichever thread runs it
+    CellRandom random = grid.GetRandom(x, y);
+
+    // The stamp lives in the cell word, so it moves along with the element from here on
+    grid.SetCell(x, y, SetCellStamp(cell, grid.GetFrameCounter()));
 
     // HANDLE ALL VELOCITY BASED COMPONENTS
     // Process Gravity
-    if (HasComponent<GravityComp>(element, "Gravity"))
+    if (HasComponent<GravityComp>(cell, registry))
     {
-        auto* comp = TryGetComponent<GravityComp>(element, "Gravity");
-        element->velocity.x += GRAVITY * comp->gravityScale * ServiceLocator::GetSandSimulator().GetFixedTimeStep();
+        auto* comp = TryGetComponent<GravityComp>(cell, registry);
+        element->velocity.x += GRAVITY * comp->gravityScale * grid.GetFixedTimeStep();
     }
 
     // HANDLE MODIFIER COMPONENTS
     // Additional components (flammable, etc.)
-    if (!element->hasSpread)
-    {
-        UpdateSpreading(element, x, y, grid);
-        element->hasSpread = true;
-    }
-    UpdateLifetime(element, x, y, grid);
+    UpdateSpreading(cell, x, y, grid, random);
+    UpdateLifetime(element, x, y, grid, random);
+
+    // The lifetime update can change the element type or remove it
+    cell = grid.GetCell(x, y);
+    if (cell == EMPTY_CELL_STATE) return;
 
     // Cache if the element is Solid, Liquid or Gas to reduce checking it in the Bresenham's algorithm
-    bool isSolid = HasComponent<SolidComp>(element, "Solid");
+    bool isSolid = HasComponent<SolidComp>(cell, registry);
     bool isLiquid = false;
     bool isGas = false;
 
     if (!isSolid)
     {
-        isLiquid = HasComponent<LiquidComp>(element, "Liquid");
+        isLiquid = HasComponent<LiquidComp>(cell, registry);
     }
     if (!isLiquid)
     {
-        isGas = HasComponent<GasComp>(element, "Gas");
+        isGas = HasComponent<GasComp>(cell, registry);
     }
 
     // Calculate the target position based on current velocity
@@ -91,9 +110,10 @@ void UpdateGridElement(Grid& grid, int x, int y)
         y + static_cast<int>(element->velocity.y)  // Vertical movement (columns)
     };
 
-    // Clamp target position to grid bounds
-    targetPos.x = std::clamp(targetPos.x, 0, grid.GetRows() - 1);
-    targetPos.y = std::clamp(targetPos.y, 0, grid.GetColumns() - 1);
+    // Clamp target position to grid bounds and to how far one move may reach
+    const int maxReach = grid.GetMaxReach();
+    targetPos.x = std::clamp(targetPos.x, std::max(x - maxReach, 0), std::min(x + maxReach, grid.GetRows() - 1));
+    targetPos.y = std::clamp(targetPos.y, std::max(y - maxReach, 0), std::min(y + maxReach, grid.GetColumns() - 1));
 
     // Use Bresenham's line to check for available positions from start to target
     glm::ivec2 lastValidPos{ startPos };
@@ -140,8 +160,12 @@ void UpdateGridElement(Grid& grid, int x, int y)
                 return false;
             });
 
-        // now place element at last valid pos
-        grid.SwapElements(x, y, lastValidPos.x, lastValidPos.y);
+        // now place element at last valid pos, unless another thread got one of the cells first.
+        // Every position the line got to was empty when it was checked
+        if (!grid.SwapElements(x, y, lastValidPos.x, lastValidPos.y, EMPTY_CELL_STATE))
+        {
+            lastValidPos = startPos;
+        }
 
         if (x == lastValidPos.x && y == lastValidPos.y)
         {
@@ -153,94 +177,111 @@ void UpdateGridElement(Grid& grid, int x, int y)
     // NOW DO OUR FINAL MAIN COMPONENTS
     if (isSolid)
     {
-        ProcessSolid(element, lastValidPos.x, lastValidPos.y, grid);
+        ProcessSolid(lastValidPos.x, lastValidPos.y, grid, random);
     }
     else if (isLiquid)
     {
-        auto* liquidComp = TryGetComponent<LiquidComp>(element, "Liquid");
-        ProcessLiquid(element, lastValidPos.x, lastValidPos.y, grid, liquidComp->dispersionRate);
+        auto* liquidComp = TryGetComponent<LiquidComp>(cell, registry);
+        ProcessLiquid(lastValidPos.x, lastValidPos.y, grid, random, liquidComp->dispersionRate);
     }
     else if (isGas)
     {
-        ProcessGas(element, lastValidPos.x, lastValidPos.y, grid);
+        ProcessGas(lastValidPos.x, lastValidPos.y, grid, random);
     }
-    element->hasMoved = true;
 }
 
-void UpdateGridElements(Grid& grid)
+void UpdateChunk(Grid& grid, int chunkIndex)
 {
-    const int CHUNK_SIZE = grid.GetChunkSize();
-    const int ROWS = grid.GetRows();
-    const int COLS = grid.GetColumns();
-    const int CHUNKS_X = grid.GetNumChunksX();
-    const int CHUNKS_Y = grid.GetNumChunksY();
+    // Only the dirty part of the chunk can change
+    const DirtyRect& dirtyRect = grid.m_CurrentDirtyChunks.GetRect(chunkIndex);
+    const bool isLeftToRight = grid.IsEvenFrame();
 
-    for (int chunkX{ CHUNKS_X - 1 }; chunkX >= 0; --chunkX)
+    for (int x{ dirtyRect.maxX }; x >= dirtyRect.minX; --x)
     {
-        for (int chunkY{}; chunkY < CHUNKS_Y; ++chunkY)
+        // Jump from one occupied cell to the next instead of checking every cell, left to right on even frames
+        // and right to left on odd ones. Elements can move into the cells still ahead, so the row gets
+        // scanned again after every update, which costs far less than the update itself
+        uint64_t occupiedAhead = grid.FindOccupiedCells(x, dirtyRect.minY, dirtyRect.maxY);
+        while (occupiedAhead)
         {
-            //if (!grid.IsChunkDirty(chunkX, chunkY)) continue;
-            if (!grid.m_CurrentDirtyChunks[chunkX][chunkY])
-                continue;
+            const int offset = isLeftToRight ? std::countr_zero(occupiedAhead) : 63 - std::countl_zero(occupiedAhead);
+            UpdateGridElement(grid, x, dirtyRect.minY + offset);
 
-            int startX = chunkX * CHUNK_SIZE;
-            int endX = std::min(startX + CHUNK_SIZE, ROWS);
-
-            for (int x{ endX - 1 }; x >= startX; --x)
-            {
-                int startY = grid.IsEvenFrame() 
-                    ? chunkY * CHUNK_SIZE :
-                    std::min(chunkY * CHUNK_SIZE + CHUNK_SIZE, COLS) - 1;
-                int endY = grid.IsEvenFrame()
-                    ? std::min(startY + CHUNK_SIZE, COLS):
-                    chunkY * CHUNK_SIZE - 1;
-
-                int step = grid.IsEvenFrame() ? 1 : -1;
-
-                for (int y{ startY }; y != endY; y += step)
-                {
-                    if (grid.IsEmpty(x, y)) continue;
-                    UpdateGridElement(grid, x, y);
-                }
-            }
+            const uint64_t notVisited = isLeftToRight ? ~uint64_t{} << offset << 1 : (uint64_t{ 1 } << offset) - 1;
+            occupiedAhead = grid.FindOccupiedCells(x, dirtyRect.minY, dirtyRect.maxY) & notVisited;
         }
     }
+}
 
-    std::swap(grid.m_CurrentDirtyChunks, grid.m_NextDirtyChunks);
+void UpdateGridElements(Grid& grid)
+{
+    const int CHUNKS_Y = grid.GetNumChunksY();
 
-    grid.ResetDirtyChunks();
+    // Process the dirty chunks bottom row of chunks first, left to right within a row of chunks
+    std::vector<int>& activeChunks = grid.m_CurrentDirtyChunks.GetActiveChunks();
+    std::sort(activeChunks.begin(), activeChunks.end(), [CHUNKS_Y](int a, int b)
+        {
+            const int chunkXA = a / CHUNKS_Y;
+            const int chunkXB = b / CHUNKS_Y;
+            return chunkXA != chunkXB ? chunkXA > chunkXB : a < b;
+        });
 
-    for (int chunkX = 0; chunkX < CHUNKS_X; ++chunkX)
+    if (const GridBand* pBand = grid.GetBand())
     {
-        for (int chunkY = 0; chunkY < CHUNKS_Y; ++chunkY)
+        // A band of a sharded world: chunk rows of one parity are a whole chunk row apart, like the checkerboard,
+        // so every band updates them at the same time and the rows around the bands are exchanged in between.
+        // The halo chunk rows outside the band belong to the neighbours and are left alone.
+        const int bottomParity = (pBand->worldNumChunksX - 1) % 2;
+        const int worldFirstChunkX = pBand->worldFirstRow / grid.GetChunkSize();
+        for (int rowPhase{}; rowPhase < 2; ++rowPhase)
         {
-            if (!grid.m_CurrentDirtyChunks[chunkX][chunkY])
-                continue;
-
-            int startX = chunkX * CHUNK_SIZE;
-            int endX = std::min(startX + CHUNK_SIZE, ROWS);
-            int startY = chunkY * CHUNK_SIZE;
-            int endY = std::min(startY + CHUNK_SIZE, COLS);
-
-            for (int x = startX; x < endX; ++x)
+            for (int chunkIndex : activeChunks)
             {
-                for (int y = startY; y < endY; ++y)
-                {
-                    Element* element = grid.GetElementData(x, y);
-                    if (!element) continue;
-
-                    if (element->toBeDestroyed)
-                    {
-                        grid.RemoveElementAt(x, y);
-                        continue;
-                    }
+                const int chunkX = chunkIndex / CHUNKS_Y;
+                if (chunkX < pBand->firstChunkX || chunkX > pBand->lastChunkX) continue;
+                if ((worldFirstChunkX + chunkX) % 2 != (bottomParity + rowPhase) % 2) continue;
 
-                    element->hasMoved = false;
-                    element->hasSpread = false;
-                }
+                UpdateChunk(grid, chunkIndex);
             }
+            pBand->onRowPhaseDone();
         }
     }
+    else if (grid.GetUpdateScheduling() == UpdateScheduling::Checkerboard)
+    {
+        // 2x2 checkerboard: chunks of the same phase are a whole chunk apart and nothing reaches
+        // further than half a chunk (see Grid::GetMaxReach), so a phase's chunks can run at the same time.
+        // The bottom row of chunks goes first, like the serial order.
+        const int bottomParity = (grid.GetNumChunksX() - 1) % 2;
+        std::array<std::vector<int>, 4> phases{};
+        for (int chunkIndex : activeChunks)
+        {
+            const int chunkX = chunkIndex / CHUNKS_Y;
+            const int chunkY = chunkIndex % CHUNKS_Y;
+            phases[(chunkX % 2 != bottomParity) * 2 + chunkY % 2].push_back(chunkIndex);
+        }
+
+        for (const std::vector<int>& phase : phases)
+        {
+            grid.UpdateChunksInParallel(phase, [&grid](int chunkIndex) { UpdateChunk(grid, chunkIndex); });
+        }
+    }
+    else if (grid.GetUpdateScheduling() == UpdateScheduling::Optimistic)
+    {
+        // Every active chunk at once, neighbouring chunks fight over the cells near their border
+        // and the loser of a claim waits for the next tick (see Grid::SwapElements)
+        grid.UpdateChunksInParallel(activeChunks, [&grid](int chunkIndex) { UpdateChunk(grid, chunkIndex); }, true);
+    }
+    else
+    {
+        for (int chunkIndex : activeChunks)
+        {
+            UpdateChunk(grid, chunkIndex);
+        }
+    }
+
+    std::swap(grid.m_CurrentDirtyChunks, grid.m_NextDirtyChunks);
+
+    grid.ResetDirtyChunks();
 }
 
 bool CanSolidReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid)
@@ -252,19 +293,20 @@ bool CanSolidReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid)
 		return false; // Target is outside the grid bounds
 	}
 
-    Element* const targetElement = grid.GetElementData(target);
+    const Cell targetCell = grid.GetCell(target);
+    const ElementRegistry* registry = grid.GetElementRegistry();
 
-	bool isSolid = HasComponent<SolidComp>(targetElement, "Solid");
+	bool isSolid = HasComponent<SolidComp>(targetCell, registry);
 	bool isLiquid = false;
 	bool isGas = false;
 
 	if (!isSolid)
 	{
-		isLiquid = HasComponent<LiquidComp>(targetElement, "Liquid");
+		isLiquid = HasComponent<LiquidComp>(targetCell, registry);
 	}
 	else if (!isLiquid)
 	{
-		isGas = HasComponent<GasComp>(targetElement, "Gas");
+		isGas = HasComponent<GasComp>(targetCell, registry);
 	}
 
 	// If the direction is valid, determine if the target position is reachable
@@ -319,18 +361,19 @@ bool CanLiquidReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid)
 		return false; // Target is outside the grid bounds
 	}
 
-	Element* const targetElement = grid.GetElementData(target);
-	bool isSolid = HasComponent<SolidComp>(targetElement, "Solid");
+	const Cell targetCell = grid.GetCell(target);
+    const ElementRegistry* registry = grid.GetElementRegistry();
+	bool isSolid = HasComponent<SolidComp>(targetCell, registry);
 	bool isLiquid = false;
 	bool isGas = false;
 
 	if (!isSolid)
 	{
-		isLiquid = HasComponent<LiquidComp>(targetElement, "Liquid");
+		isLiquid = HasComponent<LiquidComp>(targetCell, registry);
 	}
 	else if (!isLiquid)
 	{
-		isGas = HasComponent<GasComp>(targetElement, "Gas");
+		isGas = HasComponent<GasComp>(targetCell, registry);
 	}
 
 	// If the direction is valid, determine if the target position is reachable
@@ -383,18 +426,19 @@ bool CanGasReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid)
 		return false;
 	}
 
-	Element* const targetElement = grid.GetElementData(target);
-	bool isSolid = HasComponent<SolidComp>(targetElement, "Solid");
+	const Cell targetCell = grid.GetCell(target);
+    const ElementRegistry* registry = grid.GetElementRegistry();
+	bool isSolid = HasComponent<SolidComp>(targetCell, registry);
 	bool isLiquid = false;
 	bool isGas = false;
 
 	if (!isSolid)
 	{
-		isLiquid = HasComponent<LiquidComp>(targetElement, "Liquid");
+		isLiquid = HasComponent<LiquidComp>(targetCell, registry);
 	}
 	else if (!isLiquid)
 	{
-		isGas = HasComponent<GasComp>(targetElement, "Gas");
+		isGas = HasComponent<GasComp>(targetCell, registry);
 	}
 
 	// If the direction is valid, determine if the target position is reachable
@@ -440,32 +484,36 @@ bool CanGasReachTarget(glm::ivec2 start, glm::ivec2 target, Grid& grid)
 	return false; // Default to unreachable if no valid direction is matched
 }
 
-void ProcessGas(Element* element, int x, int y, Grid& grid)
+void ProcessGas(int x, int y, Grid& grid, CellRandom& random)
 {
+    const ElementRegistry* registry = grid.GetElementRegistry();
+
     // Check if the element below (downwards) is empty
-    if (x > 0 && (grid.IsEmpty(x - 1, y) || HasComponent<LiquidComp>(grid.GetElementData(x - 1, y), "Liquid")))
+    // The grid border is never empty, so direct neighbours need no bounds checks
+    const Cell cellBelow = grid.GetCell(x - 1, y);
+    if (cellBelow == EMPTY_CELL_STATE || HasComponent<LiquidComp>(cellBelow, registry))
     {
-        grid.SwapElements(x, y, x - 1, y); // Move down
+        grid.SwapElements(x, y, x - 1, y, cellBelow); // Move down
         return; // Movement was successful
     }
     else
     {
         // Randomize horizontal preference to simulate natural spread
-        bool moveRightFirst = (rand() % 2 == 0);
+        bool moveRightFirst = random.NextBool();
 
         // Helper function to check diagonal movement
         auto tryMoveDiagonal = [&](int dx, int dy) -> bool
             {
                 int targetX = x - 1; // Always check one row down
                 int targetY = y + dy;
-                if (grid.IsWithinBounds(targetX, targetY) && grid.IsEmpty(targetX, targetY))
+                if (grid.IsEmpty(targetX, targetY))
                 {
                     // Check if the horizontal neighbor blocks diagonal movement
                     int neighborX = x;
                     int neighborY = y + dy;
-                    if (grid.IsWithinBounds(neighborX, neighborY) && grid.IsEmpty(neighborX, neighborY))
+                    if (grid.IsEmpty(neighborX, neighborY))
                     {
-                        grid.SwapElements(x, y, targetX, targetY); // Move diagonally
+                        grid.SwapElements(x, y, targetX, targetY, EMPTY_CELL_STATE); // Move diagonally
                         return true; // Movement was successful
                     }
                 }
@@ -488,15 +536,15 @@ void ProcessGas(Element* element, int x, int y, Grid& grid)
         auto tryHorizontal = [&](int dy) -> bool
             {
                 int newY = y + dy;
-                if (grid.IsWithinBounds(x, newY) && grid.IsEmpty(x, newY))
+                if (grid.IsEmpty(x, newY))
                 {
-                    grid.SwapElements(x, y, x, newY);
+                    grid.SwapElements(x, y, x, newY, EMPTY_CELL_STATE);
                     return false; // Movement was successful
                 }
                 return true; // Movement was blocked
             };
 
-        int maxDispersion = 5;
+        int maxDispersion = std::min(5, grid.GetMaxReach());
         for (int step = 1; step <= maxDispersion; step++)
         {
             if (moveRightFirst)
@@ -513,32 +561,33 @@ void ProcessGas(Element* element, int x, int y, Grid& grid)
     }
 }
 
-void ProcessLiquid(Element* element, int x, int y, Grid& grid, float dispersionRate)
+void ProcessLiquid(int x, int y, Grid& grid, CellRandom& random, float dispersionRate)
 {
     // Check if the element below (downwards) is empty
-    if (x < grid.GetRows() - 1 && grid.IsEmpty(x + 1, y))
+    // The grid border is never empty, so direct neighbours need no bounds checks
+    if (grid.IsEmpty(x + 1, y))
     {
-        grid.SwapElements(x, y, x + 1, y); // Move down
+        grid.SwapElements(x, y, x + 1, y, EMPTY_CELL_STATE); // Move down
         return; // Movement was successful
     }
     else
     {
         // Randomize horizontal preference to simulate natural spread
-        bool moveRightFirst = (rand() % 2 == 0);
+        bool moveRightFirst = random.NextBool();
 
         // Helper function to check diagonal movement
         auto tryMoveDiagonal = [&](int dx, int dy) -> bool 
             {
             int targetX = x + 1; // Always check one row down
             int targetY = y + dy;
-            if (grid.IsWithinBounds(targetX, targetY) && grid.IsEmpty(targetX, targetY))
+            if (grid.IsEmpty(targetX, targetY))
             {
                 // Check if the horizontal neighbor blocks diagonal movement
                 int neighborX = x;
                 int neighborY = y + dy;
-                if (grid.IsWithinBounds(neighborX, neighborY) && grid.IsEmpty(neighborX, neighborY))
+                if (grid.IsEmpty(neighborX, neighborY))
                 {
-                    grid.SwapElements(x, y, targetX, targetY); // Move diagonally
+                    grid.SwapElements(x, y, targetX, targetY, EMPTY_CELL_STATE); // Move diagonally
                     return true; // Movement was successful
                 }
             }
@@ -561,15 +610,15 @@ void ProcessLiquid(Element* element, int x, int y, Grid& grid, float dispersionR
         auto tryHorizontal = [&](int dy) -> bool
             {
                 int newY = y + dy;
-                if (grid.IsWithinBounds(x, newY) && grid.IsEmpty(x, newY))
+                if (grid.IsEmpty(x, newY))
                 {
-                    grid.SwapElements(x, y, x, newY);
+                    grid.SwapElements(x, y, x, newY, EMPTY_CELL_STATE);
                     return false; // Movement was successful
                 }
                 return true; // Movement was blocked
             };
 
-        int maxDispersion = static_cast<int>(dispersionRate);
+        int maxDispersion = std::min(static_cast<int>(dispersionRate), grid.GetMaxReach());
         for (int step = 1; step <= maxDispersion; step++)
         {
             if (moveRightFirst)
@@ -586,32 +635,37 @@ void ProcessLiquid(Element* element, int x, int y, Grid& grid, float dispersionR
     }
 }
 
-void ProcessSolid(Element* element, int x, int y, Grid& grid)
+void ProcessSolid(int x, int y, Grid& grid, CellRandom& random)
 {
+    const ElementRegistry* registry = grid.GetElementRegistry();
+
     // Check if the element below (downwards) is empty or has a liquid component
-    if (x < grid.GetRows() - 1 && (grid.IsEmpty(x + 1, y) || HasComponent<LiquidComp>(grid.GetElementData(x + 1, y), "Liquid")))
+    // The grid border is never empty, so direct neighbours need no bounds checks
+    const Cell cellBelow = grid.GetCell(x + 1, y);
+    if (cellBelow == EMPTY_CELL_STATE || HasComponent<LiquidComp>(cellBelow, registry))
     {
-        grid.SwapElements(x, y, x + 1, y); // Move down
+        grid.SwapElements(x, y, x + 1, y, cellBelow); // Move down
         return; // Movement was successful
     }
     else
     {
         // Randomize horizontal preference to simulate natural spread
-        bool moveRightFirst = (rand() % 2 == 0);
+        bool moveRightFirst = random.NextBool();
 
         // Helper function to check diagonal movement
         auto tryMoveDiagonal = [&](int dx, int dy) -> bool 
             {
             int targetX = x + 1; // Always check one row down
             int targetY = y + dy;
-            if (grid.IsWithinBounds(targetX, targetY) && (grid.IsEmpty(targetX, targetY) || HasComponent<LiquidComp>(grid.GetElementData(targetX, targetY), "Liquid")))
+            const Cell targetCell = grid.GetCell(targetX, targetY);
+            if (targetCell == EMPTY_CELL_STATE || HasComponent<LiquidComp>(targetCell, registry))
             {
                 // Check if the horizontal neighbor blocks diagonal movement
                 int neighborX = x;
                 int neighborY = y + dy;
-                if (grid.IsWithinBounds(neighborX, neighborY) && (grid.IsEmpty(neighborX, neighborY) || HasComponent<LiquidComp>(grid.GetElementData(neighborX, neighborY), "Liquid")))
+                if (grid.IsEmpty(neighborX, neighborY) || HasComponent<LiquidComp>(grid.GetCell(neighborX, neighborY), registry))
                 {
-                    grid.SwapElements(x, y, targetX, targetY); // Move diagonally
+                    grid.SwapElements(x, y, targetX, targetY, targetCell); // Move diagonally
                     return true; // Movement was successful
                 }
             }
@@ -632,10 +686,12 @@ void ProcessSolid(Element* element, int x, int y, Grid& grid)
     }
 }
 
-void UpdateSpreading(Element* element, int x, int y, Grid& grid)
+void UpdateSpreading(Cell cell, int x, int y, Grid& grid, CellRandom& random)
 {
+    const ElementRegistry* registry = grid.GetElementRegistry();
+
     // Check if the element has a spreading component
-    const SpreadingComp* spreadingComp = TryGetComponent<SpreadingComp>(element, "Spreading");
+    const SpreadingComp* spreadingComp = TryGetComponent<SpreadingComp>(cell, registry);
     if (!spreadingComp)
         return; // No spreading component, exit early
 
@@ -655,70 +711,80 @@ void UpdateSpreading(Element* element, int x, int y, Grid& grid)
             if (!grid.IsWithinBounds(neighborX, neighborY))
                 continue;
 
-            float randomChance = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+            float randomChance = random.NextFloat();
             if (randomChance > spreadingComp->spreadChance) continue;
 
-            Element* neighbor = grid.GetElementData(neighborX, neighborY);
+            Cell neighborCell = grid.GetCell(neighborX, neighborY);
 
             // Check if the neighbor has a Spreadable component (such as Flammable)
-            const SpreadableComp* spreadableComp = TryGetComponent<SpreadableComp>(neighbor, "Spreadable");
+            const SpreadableComp* spreadableComp = TryGetComponent<SpreadableComp>(neighborCell, registry);
             if (!spreadableComp) continue;
             
             // Spread if the spreading factor is greater than the spread threshold
             if (spreadingComp->spreadFactor > spreadableComp->spreadThreshold)
             {
+                // The neighbour may belong to an element another thread is moving in the optimistic update
+                if (!grid.ClaimCell(neighborX, neighborY, neighborCell)) continue;
+
+                Element* neighbor = grid.GetElementData(neighborX, neighborY);
                 ++neighbor->spreadCount;
 
                 // Replace the neighbor with the current element type
-                // Assign the new element definition to the neighbor
+                // Assign the new element type to the neighbor
                 if (neighbor->spreadCount >= spreadableComp->spreadResistance)
                 {
-                    neighbor->definition = element->definition;
+                    neighborCell = SetCellType(neighborCell, GetCellType(cell));
 
-                    const LifeTimeComp* lifetimeComp = TryGetComponent<LifeTimeComp>(neighbor, "Lifetime");
+                    const LifeTimeComp* lifetimeComp = TryGetComponent<LifeTimeComp>(neighborCell, registry);
                     if(lifetimeComp)
                     {
-                        neighbor->lifeTime = lifetimeComp->minLifeTime + static_cast<float>(rand()) / static_cast<float>(RAND_MAX / (lifetimeComp->maxLifeTime - lifetimeComp->minLifeTime));;
-                        neighbor->hasMoved = true;
+                        neighbor->lifeTime = GetRandomFloat(random, lifetimeComp->minLifeTime, lifetimeComp->maxLifeTime);
+                        neighborCell = SetCellStamp(neighborCell, grid.GetFrameCounter());
                     }
 
+                    grid.SetCell(neighborX, neighborY, neighborCell);
+                    grid.RecolorCell(neighborX, neighborY);
+                    // A new element, it wakes its surroundings like an element that moved there
+                    grid.MarkChunkAsDirty(neighborX, neighborY);
                     neighbor->spreadCount = 0;
                 }
+                grid.ReleaseCell(neighborX, neighborY);
             }
         }
     }
 }
 
-void UpdateLifetime(Element* element, int x, int y, Grid& grid)
+void UpdateLifetime(Element* element, int x, int y, Grid& grid, CellRandom& random)
 {
-    const LifeTimeComp* lifetimeComp = TryGetComponent<LifeTimeComp>(element, "Lifetime");
+    const Cell cell = grid.GetCell(x, y);
+    const LifeTimeComp* lifetimeComp = TryGetComponent<LifeTimeComp>(cell, grid.GetElementRegistry());
     if (!lifetimeComp)
         return;
 
     grid.MarkChunkAsDirty(x, y);
-    element->lifeTime -= ServiceLocator::GetSandSimulator().GetFixedTimeStep();
+    element->lifeTime -= grid.GetFixedTimeStep();
     if (element->lifeTime <= 0)
     {
-        //grid.RemoveElementAt(x, y);
         const ElementDefinition* elementDef = grid.GetElementRegistry()->GetElementType(lifetimeComp->elementToSpawn);
         if (elementDef)
         {
-            element->lifeTime = GetRandomFloat(lifetimeComp->minLifeTime, lifetimeComp->maxLifeTime);
-            element->definition = elementDef;
+            element->lifeTime = GetRandomFloat(random, lifetimeComp->minLifeTime, lifetimeComp->maxLifeTime);
+            grid.SetCell(x, y, SetCellType(cell, elementDef->typeID));
+            grid.RecolorCell(x, y);
         }
         else
         {
-            element->toBeDestroyed = true;
+            grid.RemoveElementAt(x, y);
         }
     }
 }
 
-float GetRandomFloat(float min, float max)
+float GetRandomFloat(CellRandom& random, float min, float max)
 {
     // Ensure the range is valid
     if (min > max) std::swap(min, max);
 
     // Scale and shift the random value
-    return min + static_cast<float>(rand()) / static_cast<float>(RAND_MAX / (max - min));
+    return random.NextFloat(min, max);
 }
 #endif // !SYSTEMS_H
\ No newline at end of file
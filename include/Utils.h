@@ -47,7 +47,7 @@ void BresenhamLine(const glm::ivec2& start, const glm::ivec2& end, Func&& func)
     }
 }
 
-ImVec4 HexToImVec4(uint32_t hexColor) 
+inline ImVec4 HexToImVec4(uint32_t hexColor)
 {
     float r = ((hexColor >> 16) & 0xFF) / 255.0f;
     float g = ((hexColor >> 8) & 0xFF) / 255.0f;
@@ -0,0 +1,124 @@
+#include "BatchRunner.h"
+#include "JobSystem.h"
+#include "SimdKernels.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+
+BatchRunner::BatchRunner(const BatchSettings& settings)
+	: m_Settings{ settings },
+	m_WorldSetup{ [this](Grid& grid, int worldIndex) { SetupDefaultWorld(grid, worldIndex); } }
+{
+	if (m_Settings.worldCount <= 0 || m_Settings.rows <= 0 || m_Settings.columns <= 0)
+	{
+		throw std::runtime_error("World count, rows and columns must be greater than 0");
+	}
+}
+
+void BatchRunner::Run()
+{
+	using Clock = std::chrono::steady_clock;
+	const auto startTime = Clock::now();
+
+	m_Results.assign(m_Settings.worldCount, {});
+	// One world per job, the workers steal whole worlds from each other so a slow world doesn't hold up the rest
+	JobSystem::GetInstance().ParallelFor(m_Settings.worldCount, 1, [this](int worldIndex, int)
+		{
+			m_Results[worldIndex] = RunWorld(worldIndex);
+		});
+
+	PrintResults(std::chrono::duration<double>(Clock::now() - startTime).count());
+}
+
+BatchWorldResult BatchRunner::RunWorld(int worldIndex) const
+{
+	using Clock = std::chrono::steady_clock;
+
+	BatchWorldResult result{};
+	result.seed = m_Settings.seed + worldIndex;
+
+	Grid grid{ GridInfo{ glm::ivec2{}, m_Settings.rows, m_Settings.columns, 1, m_Settings.layout, result.seed } };
+	grid.SetFixedTimeStep(m_Settings.fixedTimeStep);
+	m_WorldSetup(grid, worldIndex);
+
+	const auto startTime = Clock::now();
+	for (int tick{}; tick < m_Settings.ticks; ++tick)
+	{
+		grid.FixedUpdate();
+	}
+	result.seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+	result.ticksPerSecond = result.seconds > 0.0 ? m_Settings.ticks / result.seconds : 0.0;
+	result.activeChunks = static_cast<int>(grid.m_CurrentDirtyChunks.GetActiveChunks().size());
+
+	const ElementRegistry* registry = grid.GetElementRegistry();
+	const std::vector<int> typeCounts = grid.CountElementTypes();
+	for (size_t typeID{ 1 }; typeID < typeCounts.size(); ++typeID)
+	{
+		if (typeCounts[typeID] == 0) continue;
+		result.elementCounts.emplace_back(registry->GetElementType(static_cast<ElementTypeID>(typeID))->name, typeCounts[typeID]);
+	}
+
+	return result;
+}
+
+void BatchRunner::SetupDefaultWorld(Grid& grid, int worldIndex) const
+{
+	constexpr std::array<const char*, 5> ELEMENT_NAMES{ "Sand", "Water", "Smoke", "Wood", "Snow" };
+	constexpr int BLOBS_PER_ELEMENT{ 4 };
+	constexpr int LEDGE_COUNT{ 3 };
+
+	const int rows = grid.GetRows();
+	const int columns = grid.GetColumns();
+	CellRandom random{ m_Settings.seed + worldIndex, 0, EDIT_RANDOM_STREAM, -1, -1 };
+
+	// Ledges in the lower half so the falling elements pile up and flow off them
+	for (int ledge{}; ledge < LEDGE_COUNT; ++ledge)
+	{
+		const int x = random.NextInt(rows / 2, rows - 1);
+		const int startY = random.NextInt(0, columns - 1);
+		const int length = random.NextInt(columns / 8, columns / 3);
+		for (int y{ startY }; y < std::min(startY + length, columns); ++y)
+		{
+			grid.AddElementAt(x, y, "Wall");
+		}
+	}
+
+	const int maxBrushSize = std::max(2, std::min(rows, columns) / 16);
+	for (const char* elementName : ELEMENT_NAMES)
+	{
+		for (int blob{}; blob < BLOBS_PER_ELEMENT; ++blob)
+		{
+			const int x = random.NextInt(0, rows / 2);
+			const int y = random.NextInt(0, columns - 1);
+			grid.AddElementBrushed(x, y, random.NextInt(2, maxBrushSize), elementName, false);
+		}
+	}
+}
+
+void BatchRunner::PrintResults(double totalSeconds) const
+{
+	int64_t totalTicks{};
+	std::cout << "Ran " << m_Settings.worldCount << " worlds of " << m_Settings.rows << "x" << m_Settings.columns
+		<< " for " << m_Settings.ticks << " ticks with " << GetSimdLevelName(GetSimdLevel()) << " kernels\n";
+
+	for (size_t worldIndex{}; worldIndex < m_Results.size(); ++worldIndex)
+	{
+		const BatchWorldResult& result = m_Results[worldIndex];
+		totalTicks += m_Settings.ticks;
+
+		std::cout << "World " << worldIndex << " (seed " << result.seed << "): "
+			<< std::fixed << std::setprecision(1) << result.ticksPerSecond << " ticks/s, "
+			<< result.activeChunks << " active chunks,";
+		for (const auto& [elementName, count] : result.elementCounts)
+		{
+			std::cout << ' ' << elementName << ' ' << count;
+		}
+		std::cout << '\n';
+	}
+
+	std::cout << "Total: " << std::fixed << std::setprecision(2) << totalSeconds << " s, "
+		<< std::setprecision(1) << (totalSeconds > 0.0 ? totalTicks / totalSeconds : 0.0) << " world ticks/s\n";
+}
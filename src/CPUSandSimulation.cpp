@@ -38,7 +38,7 @@ void CPUSandSimulation::Update()
 
     if (InputManager::GetInstance().IsKeyPressed(SDL_SCANCODE_S))
     {
-        m_pGrid->FixedUpdate();
+        m_IsStepRequested = true;
         std::cout << "STEPPED SIMULATION\n";
     }
 
@@ -47,10 +47,59 @@ void CPUSandSimulation::Update()
 
 void CPUSandSimulation::FixedUpdate()
 {
-    if (m_IsSimulating)
+    // The simulation thread steps on its own
+    if (m_SimulationThread.joinable()) return;
+
+    Step();
+}
+
+void CPUSandSimulation::Step()
+{
+    m_pGrid->ApplyCommands();
+
+    if (m_IsSimulating || m_IsStepRequested.exchange(false))
     {
         m_pGrid->FixedUpdate();
     }
+
+    m_pGrid->PublishSnapshot();
+}
+
+void CPUSandSimulation::SetThreaded(bool isThreaded)
+{
+    if (isThreaded == m_SimulationThread.joinable()) return;
+
+    if (isThreaded)
+    {
+        m_SimulationThread = std::jthread{ [this](std::stop_token stopToken) { SimulationLoop(stopToken); } };
+    }
+    else
+    {
+        m_SimulationThread.request_stop();
+        m_SimulationThread.join();
+    }
+}
+
+void CPUSandSimulation::SimulationLoop(std::stop_token stopToken)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto timeStep = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_pGrid->GetFixedTimeStep()));
+    auto nextStepTime = Clock::now();
+
+    while (!stopToken.stop_requested())
+    {
+        Step();
+
+        // Falling far behind (a breakpoint, a huge flood) is not worth catching up on
+        nextStepTime += timeStep;
+        const auto now = Clock::now();
+        if (now - nextStepTime > 4 * timeStep)
+        {
+            nextStepTime = now;
+        }
+
+        std::this_thread::sleep_until(nextStepTime);
+    }
 }
 
 void CPUSandSimulation::Render() const
@@ -65,10 +114,10 @@ bool CPUSandSimulation::IsActive() const
 
 float CPUSandSimulation::GetFixedTimeStep() const
 {
-    return m_FixedTimeStep;
+    return m_pGrid->GetFixedTimeStep();
 }
 
 void CPUSandSimulation::SetFixedTimeStep(float fixedTimeStep)
 {
-    m_FixedTimeStep = fixedTimeStep;
+    m_pGrid->SetFixedTimeStep(fixedTimeStep);
 }
@@ -1,15 +1,20 @@
 #include "ElementRegistry.h"
 #include <iostream>
+#include <algorithm>
 
 ElementRegistry::ElementRegistry() 
 {
+    // occupy slot 0 so no live element ever gets the EMPTY_CELL id
+    m_ElementData.emplace_back();
+    m_SlotGenerations.emplace_back();
+
     ElementDefinition sand{ "Sand", 0xD2B48C, 
         {
         {"Solid", SolidComp{1.f}},
         {"Gravity", GravityComp{2.f}}
         } 
     };
-    m_ElementTypes["Sand"] = sand;
+    AddElementType(sand);
 
     ElementDefinition water{ "Water", 0x3498DB,
         {
@@ -17,7 +22,7 @@ ElementRegistry::ElementRegistry()
             {"Gravity", GravityComp{2.f}}
         } 
     };
-    m_ElementTypes["Water"] = water;
+    AddElementType(water);
 
     ElementDefinition smoke{ "Smoke", 0x848884,
         {
@@ -25,13 +30,13 @@ ElementRegistry::ElementRegistry()
             {"Lifetime", LifeTimeComp{5.f, 8.f, "Empty"}}
         }
     };
-    m_ElementTypes["Smoke"] = smoke;
+    AddElementType(smoke);
 
     ElementDefinition wall{ "Wall", 0x2b2a2a,
     {
     }
     };
-    m_ElementTypes["Wall"] = wall;
+    AddElementType(wall);
 
     ElementDefinition wood{ "Wood", 0x784520,
     {
@@ -40,7 +45,7 @@ ElementRegistry::ElementRegistry()
         {"Gravity", GravityComp{2.f}}
     }
     };
-    m_ElementTypes["Wood"] = wood;
+    AddElementType(wood);
 
     //ElementDefinition fire{ "Fire", 0xde5f0b,
     ElementDefinition fire{ "Fire", 0xfc6908,
@@ -49,7 +54,7 @@ ElementRegistry::ElementRegistry()
         {"Lifetime", LifeTimeComp{1.f, 1.5f, "Smoke"}}
     }
     };
-    m_ElementTypes["Fire"] = fire;
+    AddElementType(fire);
     //#ABF0E5
     ElementDefinition snow{ "Snow", 0xE0F6F8,
     {
@@ -58,50 +63,68 @@ ElementRegistry::ElementRegistry()
         {"Gravity", GravityComp{2.f}}
     }
     };
-    m_ElementTypes["Snow"] = snow;
+    AddElementType(snow);
+}
+
+void ElementRegistry::Reserve(size_t elementCount)
+{
+    // +1 for the reserved EMPTY_CELL slot, this keeps Element pointers stable while the grid is filled
+    elementCount = std::min<size_t>(elementCount, MAX_ELEMENT_SLOTS - 1);
+    m_ElementData.reserve(elementCount + 1);
+    m_SlotGenerations.reserve(elementCount + 1);
+    m_FreeElementSlots.reserve(elementCount);
 }
 
-ElementID ElementRegistry::AddElement(const std::string& elementTypeName)
+ElementID ElementRegistry::AddElement(ElementTypeID typeID, CellRandom& random)
 {
-    ElementID id = m_NextElementID++;
-    auto it = m_ElementTypes.find(elementTypeName);
-    assert(it != m_ElementTypes.end() && "Element type not found! Ensure the type is correctly registered.");
+    assert(typeID != EMPTY_TYPE && typeID < m_ElementTypesByID.size() && "Element type not found! Ensure the type is correctly registered.");
 
-    // If assertions are disabled
-    if (it == m_ElementTypes.end())
+    std::lock_guard lock{ m_SlotMutex };
+
+    // Reuse the most recently released slot if possible, only grow the slot array when none are left
+    uint32_t index{};
+    if (!m_FreeElementSlots.empty())
     {
-        std::cout << "Warning: Element \"" + elementTypeName + "\" not found! Returning EMPTY_CELL.\n";
-        return EMPTY_CELL;
+        index = m_FreeElementSlots.back();
+        m_FreeElementSlots.pop_back();
     }
+    else
+    {
+        if (m_ElementData.size() >= MAX_ELEMENT_SLOTS)
+        {
+            std::cout << "Warning: Out of element slots! Returning EMPTY_CELL.\n";
+            return EMPTY_CELL;
+        }
 
-    // Generate a random tint adjustment (-15 to +15)
-    int8_t randomTint = static_cast<int8_t>((rand() % 31) - 15);
-
-    m_ElementData[id] = { &m_ElementTypes[elementTypeName], glm::vec2{0.0f, 0.0f}, false, false, 0, randomTint };
+        index = static_cast<uint32_t>(m_ElementData.size());
+        m_ElementData.emplace_back();
+        m_SlotGenerations.emplace_back();
+    }
 
-    Element* element = GetElementData(id);
+    const ElementID id = MakeElementID(index, m_SlotGenerations[index]);
+    Element& element = m_ElementData[index];
+    element = {};
 
-    if (element)
+    if (m_ComponentMasks[typeID] & ComponentBit<LifeTimeComp>)
     {
-        auto it = element->definition->components.find("Lifetime");
-        if (it != element->definition->components.end())
-        {
-            const LifeTimeComp* lifetimeComp = std::get_if<LifeTimeComp>(&it->second); // Safely retrieve the component
-            element->lifeTime = lifetimeComp->minLifeTime + static_cast<float>(rand()) / static_cast<float>(RAND_MAX / (lifetimeComp->maxLifeTime - lifetimeComp->minLifeTime));;
-        }
+        const LifeTimeComp* lifetimeComp = &GetComponent<LifeTimeComp>(typeID);
+        element.lifeTime = random.NextFloat(lifetimeComp->minLifeTime, lifetimeComp->maxLifeTime);
     }
     return id;
 }
 
 void ElementRegistry::RemoveElement(ElementID id) 
 {
-    m_ElementData.erase(id);
-}
+    std::lock_guard lock{ m_SlotMutex };
 
-Element* ElementRegistry::GetElementData(ElementID id)
-{
-    auto it = m_ElementData.find(id);
-    return it != m_ElementData.end() ? &it->second : nullptr;
+    // Ignore stale handles so a slot is never released twice
+    if (!IsValid(id)) return;
+
+    const uint32_t index = GetElementIndex(id);
+    m_ElementData[index] = {};
+    // The generation wraps after 256 reuses of a slot, which is plenty to catch dangling handles
+    ++m_SlotGenerations[index];
+    m_FreeElementSlots.push_back(index);
 }
 
 const ElementDefinition* ElementRegistry::GetElementType(const std::string& name) const
@@ -117,5 +140,38 @@ const std::unordered_map<std::string, ElementDefinition>& ElementRegistry::GetEl
 
 void ElementRegistry::AddElementType(const ElementDefinition& definition)
 {
-    m_ElementTypes[definition.name] = definition;
+    std::unique_lock lock{ m_TypesMutex };
+
+    // Redefining a type keeps its id, new types get the next free one
+    auto it = m_ElementTypes.find(definition.name);
+    ElementTypeID typeID = it != m_ElementTypes.end() ? it->second.typeID : static_cast<ElementTypeID>(m_ElementTypesByID.size());
+
+    if (it == m_ElementTypes.end() && m_ElementTypesByID.size() >= BORDER_TYPE)
+    {
+        std::cout << "Warning: Too many element types, \"" + definition.name + "\" was not added!\n";
+        return;
+    }
+
+    ElementDefinition& storedDefinition = m_ElementTypes[definition.name];
+    storedDefinition = definition;
+    storedDefinition.typeID = typeID;
+    storedDefinition.componentMask = 0;
+
+    if (typeID == m_ElementTypesByID.size())
+    {
+        m_ElementTypesByID.push_back(&storedDefinition);
+        std::apply([&](auto&... tables) { (tables.resize(m_ElementTypesByID.size()), ...); }, m_ComponentTables);
+    }
+
+    // Flatten the named components into the mask and the dense parameter tables
+    for (const auto& [name, component] : storedDefinition.components)
+    {
+        storedDefinition.componentMask |= ComponentMask{ 1 } << component.index();
+        std::visit([&](const auto& comp)
+            {
+                using ComponentType = std::decay_t<decltype(comp)>;
+                std::get<std::vector<ComponentType>>(m_ComponentTables)[typeID] = comp;
+            }, component);
+    }
+    m_ComponentMasks[typeID] = storedDefinition.componentMask;
 }
\ No newline at end of file
@@ -2,8 +2,10 @@
 #include <iostream>
 #include "ServiceLocator.h"
 #include "CPUSandSimulation.h"
+#include "MargolusSandSimulation.h"
 #include "InputManager.h"
 #include <thread>
+#include <ctime>
 
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
@@ -34,7 +36,11 @@ Game::Game()
     //ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{10, 10}, 320, 480, 2 }, m_pWindow));
     int cellSize{ 2 };
     //ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{0, 0}, m_pWindow->GetHeight() / cellSize, m_pWindow->GetWidth() / cellSize, cellSize }, m_pWindow));
-    ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{20, 20}, 576 / cellSize, 1024 / cellSize, cellSize }, m_pWindow));
+    // A new seed every launch, pass a fixed one to replay a run
+    const uint64_t seed{ static_cast<uint64_t>(std::time(nullptr)) };
+    ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{20, 20}, 576 / cellSize, 1024 / cellSize, cellSize, GridLayout::RowMajor, seed }, m_pWindow));
+    // Block automaton with a fixed Sand/Water/Smoke/Wall set, scales over all cores
+    //ServiceLocator::RegisterSandSimulation(std::make_unique<MargolusSandSimulation>(GridInfo{ glm::ivec2{20, 20}, 576 / cellSize, 1024 / cellSize, cellSize, GridLayout::RowMajor, seed }, m_pWindow));
     //ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{10, 10}, 500, 500, 2 }, m_pWindow));
     //ServiceLocator::RegisterSandSimulation(std::make_unique<CPUSandSimulation>(GridInfo{ glm::ivec2{10, 10}, 40, 70, 16 }, m_pWindow));
 }
@@ -46,6 +52,8 @@ Game::~Game()
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
 
+    // The simulation owns textures of the window's renderer, they have to go before the renderer does
+    ServiceLocator::RegisterSandSimulation(nullptr);
     delete m_pWindow;
 }
 
@@ -56,7 +64,10 @@ void Game::Run()
     constexpr float TARGETFPS{ 144.0f };
     constexpr double TARGET_FRAME_DURATION = 1.0 / TARGETFPS;
     constexpr float SIMULATION_TIME_STEP = 1.0f / 60.0f;
+    // Simulate on a dedicated thread, so rendering and vsync never hold up the fixed step
+    constexpr bool USE_SIMULATION_THREAD{ true };
     ServiceLocator::GetSandSimulator().SetFixedTimeStep(SIMULATION_TIME_STEP);
+    ServiceLocator::GetSandSimulator().SetThreaded(USE_SIMULATION_THREAD);
 
     float lag = 0.0f;
     float fpsAccumulator = 0.0f;
@@ -116,6 +127,8 @@ void Game::Run()
             }
         }
     }
+
+    ServiceLocator::GetSandSimulator().SetThreaded(false);
 }
 
 void Game::ProcessInput()
@@ -2,27 +2,91 @@
 #include <SDL2/SDL.h>
 #include <thread>
 #include "InputManager.h"
-#include "ServiceLocator.h"
 #include <Systems.h>
 #include "Utils.h"
 #include <algorithm>
 #include <imgui.h>
 #include <unordered_map>
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <bit>
+#include "JobSystem.h"
+#include "ColorKernel.h"
+#include "SimdKernels.h"
+
+// Dirty set the current thread marks into during a parallel update, m_NextDirtyChunks otherwise
+static thread_local DirtyChunkSet* s_pThreadDirtyChunks{};
+// Optimistic parallel update: the cell of the element the current thread is updating (-1 if none) and its claim counters
+static thread_local int s_HeldCellIndex{ -1 };
+static thread_local ClaimStats* s_pThreadClaimStats{};
 
 Grid::Grid(const GridInfo& gridInfo)
 	: m_GridInfo(gridInfo), m_pElementRegistry(std::make_unique<ElementRegistry>())
 {
-	m_Elements.resize(gridInfo.rows, std::vector<ElementID>(gridInfo.columns, EMPTY_CELL));
 	m_NumChunksX = (m_GridInfo.rows + m_ChunkSize - 1) / m_ChunkSize;
 	m_NumChunksY = (m_GridInfo.columns + m_ChunkSize - 1) / m_ChunkSize;
-	m_CurrentDirtyChunks = std::vector<std::vector<bool>>(m_NumChunksX, std::vector<bool>(m_NumChunksY, true));
-	m_NextDirtyChunks = std::vector<std::vector<bool>>(m_NumChunksX, std::vector<bool>(m_NumChunksY, false));
-	//m_DirtyChunks = std::vector<std::vector<bool>>(m_NumChunksX, std::vector<bool>(m_NumChunksY, false));
+	m_CurrentDirtyChunks.Resize(m_NumChunksX * m_NumChunksY);
+	m_NextDirtyChunks.Resize(m_NumChunksX * m_NumChunksY);
+	m_UnpublishedChunks.Resize(m_NumChunksX * m_NumChunksY);
+	for (GridSnapshot& snapshot : m_Snapshots)
+	{
+		snapshot.cells.assign(static_cast<size_t>(m_GridInfo.rows) * m_GridInfo.columns, EMPTY_CELL_STATE);
+		snapshot.pixels.assign(snapshot.cells.size(), BACKGROUND_COLOR);
+		snapshot.staleChunks.Resize(m_NumChunksX * m_NumChunksY);
+		snapshot.uploadChunks.Resize(m_NumChunksX * m_NumChunksY);
+	}
+
+	if (m_GridInfo.layout == GridLayout::RowMajor)
+	{
+		m_RowStride = gridInfo.columns + 2 * m_BorderSize;
+		m_Cells.assign(static_cast<size_t>(gridInfo.rows + 2 * m_BorderSize) * m_RowStride, BORDER_CELL_STATE);
+		m_Elements.assign(m_Cells.size(), BORDER_CELL);
+		for (int x{}; x < gridInfo.rows; ++x)
+		{
+			std::fill_n(m_Cells.begin() + GetCellIndex(x, 0), gridInfo.columns, EMPTY_CELL_STATE);
+			std::fill_n(m_Elements.begin() + GetCellIndex(x, 0), gridInfo.columns, EMPTY_CELL);
+		}
+	}
+	else
+	{
+		// Tiled grids get the block of every chunk up front, sparse grids start without any
+		// so every chunk reads from the shared empty block
+		const int chunkBlocks = m_GridInfo.layout == GridLayout::Tiled ? m_NumChunksX * m_NumChunksY : 0;
+		m_Cells.assign(static_cast<size_t>(FIRST_CHUNK_BLOCK + chunkBlocks) * m_CellsPerChunk, EMPTY_CELL_STATE);
+		m_Elements.assign(m_Cells.size(), EMPTY_CELL);
+		std::fill_n(m_Cells.begin() + BORDER_BLOCK * m_CellsPerChunk, m_CellsPerChunk, BORDER_CELL_STATE);
+		std::fill_n(m_Elements.begin() + BORDER_BLOCK * m_CellsPerChunk, m_CellsPerChunk, BORDER_CELL);
+	}
+	m_Colors.assign(m_Cells.size(), BACKGROUND_COLOR);
+	RefreshTypeColors();
 
+	if (m_GridInfo.layout == GridLayout::Sparse)
+	{
+		m_ChunkBlocks.assign(m_NumChunksX * m_NumChunksY, EMPTY_BLOCK);
+		m_BlockChunks.assign(FIRST_CHUNK_BLOCK, -1);
+		// the registry grows with the occupied area instead of being sized for the whole world
+		return;
+	}
+
+	// every cell can hold at most one element, so this is the most the registry will ever need
+	m_pElementRegistry->Reserve(static_cast<size_t>(gridInfo.rows) * gridInfo.columns);
+	// everything gets processed on the first update
+	for (int chunkX{}; chunkX < m_NumChunksX; ++chunkX)
+	{
+		for (int chunkY{}; chunkY < m_NumChunksY; ++chunkY)
+		{
+			m_CurrentDirtyChunks.Mark(GetChunkIndex(chunkX, chunkY), GetChunkBounds(chunkX, chunkY));
+		}
+	}
 }
 
 Grid::~Grid()
 {
+	if (m_pGridTexture)
+	{
+		SDL_DestroyTexture(m_pGridTexture);
+	}
 }
 
 void Grid::Init()
@@ -50,8 +114,14 @@ void Grid::UpdateInput()
 	// ALT CLICK TO SELECT NEW ELEMENT TYPE
 	if (InputManager::GetInstance().IsKeyHeld(SDL_SCANCODE_LALT) && InputManager::GetInstance().IsMouseButtonPressed(SDL_BUTTON_LEFT))
 	{
-		const Element* element = GetElementData(gridMousePos.x, gridMousePos.y);
-		m_SelectedElement = element->definition->name;
+		// The simulation may be busy with the grid itself, pick from what is on screen
+		std::lock_guard lock{ m_SnapshotMutex };
+		const Cell cell = m_Snapshots[m_FrontSnapshot].cells[gridMousePos.x * GetColumns() + gridMousePos.y];
+		if (cell != EMPTY_CELL_STATE)
+		{
+			auto typesLock = m_pElementRegistry->LockElementTypes();
+			m_SelectedElement = m_pElementRegistry->GetElementType(GetCellType(cell))->name;
+		}
 	}
 	// CLICK TO PLACE IT
 	else if (InputManager::GetInstance().IsKeyHeld(SDL_SCANCODE_LSHIFT) && InputManager::GetInstance().IsMouseButtonHeld(SDL_BUTTON_LEFT))
@@ -61,12 +131,14 @@ void Grid::UpdateInput()
 			m_PreviousGridMousePos = gridMousePos;
 		}
 
+		GridCommand stroke{ GridCommand::Type::Brush, {}, m_BrushSize, m_BrushOverride, 1.f, m_SelectedElement };
 		BresenhamLine(m_PreviousGridMousePos, gridMousePos, [&](int x, int y)
 			{
-				AddElementBrushed(x, y, m_SelectedElement, m_BrushOverride, 1.f);
+				stroke.stamps.emplace_back(x, y);
 				return true;
 			}
 		);
+		QueueCommand(std::move(stroke));
 	}
 	else if (InputManager::GetInstance().IsMouseButtonHeld(SDL_BUTTON_LEFT))
 	{
@@ -75,12 +147,14 @@ void Grid::UpdateInput()
 			m_PreviousGridMousePos = gridMousePos;
 		}
 
+		GridCommand stroke{ GridCommand::Type::Brush, {}, m_BrushSize, m_BrushOverride, 0.01f, m_SelectedElement };
 		BresenhamLine(m_PreviousGridMousePos, gridMousePos, [&](int x, int y)
 			{
-				AddElementBrushed(x, y, m_SelectedElement, m_BrushOverride, 0.01f);
+				stroke.stamps.emplace_back(x, y);
 				return true;
 			}
 		);
+		QueueCommand(std::move(stroke));
 	}
 
 	if (InputManager::GetInstance().IsMouseButtonHeld(SDL_BUTTON_RIGHT))
@@ -90,12 +164,14 @@ void Grid::UpdateInput()
 			m_PreviousGridMousePos = gridMousePos;
 		}
 
+		GridCommand stroke{ GridCommand::Type::Erase, {}, m_BrushSize };
 		BresenhamLine(m_PreviousGridMousePos, gridMousePos, [&](int x, int y)
 			{
-				RemoveElementBrushed(x, y);
+				stroke.stamps.emplace_back(x, y);
 				return true;
 			}
 		);
+		QueueCommand(std::move(stroke));
 	}
 
 	if (InputManager::GetInstance().IsKeyPressed(SDL_SCANCODE_RETURN))
@@ -105,12 +181,14 @@ void Grid::UpdateInput()
 			m_PreviousGridMousePos = gridMousePos;
 		}
 
+		GridCommand stroke{ GridCommand::Type::Brush, {}, m_BrushSize, m_BrushOverride, 1.f, m_SelectedElement };
 		BresenhamLine(m_PreviousGridMousePos, gridMousePos, [&](int x, int y)
 			{
-				AddElementBrushed(x, y, m_SelectedElement, m_BrushOverride, 1.f);
+				stroke.stamps.emplace_back(x, y);
 				return true;
 			}
 		);
+		QueueCommand(std::move(stroke));
 	}
 
 	if (InputManager::GetInstance().IsScrolledUp())
@@ -131,15 +209,171 @@ void Grid::UpdateInput()
 void Grid::FixedUpdate()
 {
 	UpdateElements();
+	if (m_GridInfo.layout == GridLayout::Sparse)
+	{
+		ReleaseEmptyChunks();
+	}
 
-	++m_FrameCounter;
+	++m_TickCount;
 }
 
 void Grid::UpdateElements()
 {
+	m_ClaimStats = {};
+
+	// Chunks can't be allocated while other threads read the cells
+	if (IsParallelUpdate() && m_GridInfo.layout == GridLayout::Sparse)
+	{
+		PreallocateChunkNeighbours();
+	}
+
 	UpdateGridElements(*this);
 }
 
+void Grid::SetUpdateScheduling(UpdateScheduling scheduling)
+{
+	m_UpdateScheduling = scheduling;
+	if (IsParallelUpdate() && m_ThreadDirtyChunks.empty())
+	{
+		m_ThreadDirtyChunks.resize(JobSystem::GetInstance().GetThreadCount());
+		for (DirtyChunkSet& dirtyChunks : m_ThreadDirtyChunks)
+		{
+			dirtyChunks.Resize(m_NumChunksX * m_NumChunksY);
+		}
+		m_ThreadClaimStats.resize(JobSystem::GetInstance().GetThreadCount());
+	}
+}
+
+int Grid::GetMaxReach() const
+{
+	// Chunks updated at the same time are a chunk apart, so each may only touch the half chunk around it.
+	// A velocity move, the dispersion after it and the neighbour checks there together stay below that.
+	// The optimistic update claims its cells, but keeps the same reach so the same neighbours get preallocated.
+	// Bands of a sharded world update the same way, with the neighbouring band in the other chunk rows.
+	if (IsParallelUpdate() || m_Band) return m_ChunkSize / 4 - 1;
+	return std::max(m_GridInfo.rows, m_GridInfo.columns);
+}
+
+void Grid::SetBand(GridBand band)
+{
+	assert(band.worldFirstRow % m_ChunkSize == 0 && "Bands have to start on a chunk row!");
+	m_WorldFirstRow = band.worldFirstRow;
+	m_Band = std::move(band);
+}
+
+void Grid::ExportDirtyRects(int chunkX, DirtyRect* pRects)
+{
+	for (int chunkY{}; chunkY < m_NumChunksY; ++chunkY)
+	{
+		const int chunkIndex = GetChunkIndex(chunkX, chunkY);
+		if (!m_NextDirtyChunks.IsDirty(chunkIndex))
+		{
+			pRects[chunkY] = { 0, 0, -1, -1 };
+			continue;
+		}
+
+		DirtyRect rect = m_NextDirtyChunks.GetRect(chunkIndex);
+		rect.minX += m_WorldFirstRow;
+		rect.maxX += m_WorldFirstRow;
+		pRects[chunkY] = rect;
+		m_NextDirtyChunks.Unmark(chunkIndex);
+	}
+}
+
+void Grid::ImportDirtyRects(const DirtyRect* pRects)
+{
+	for (int chunkY{}; chunkY < m_NumChunksY; ++chunkY)
+	{
+		DirtyRect rect = pRects[chunkY];
+		if (rect.minX > rect.maxX) continue;
+
+		rect.minX -= m_WorldFirstRow;
+		rect.maxX -= m_WorldFirstRow;
+		m_NextDirtyChunks.Mark(GetChunkIndex(rect.minX / m_ChunkSize, chunkY), rect);
+	}
+}
+
+void Grid::ExportRows(int firstRow, int rowCount, CellRecord* pRecords) const
+{
+	for (int x{ firstRow }; x < firstRow + rowCount; ++x)
+	{
+		for (int y{}; y < m_GridInfo.columns; ++y, ++pRecords)
+		{
+			pRecords->cell = GetCell(x, y);
+			pRecords->element = pRecords->cell != EMPTY_CELL_STATE ? *GetElementData(x, y) : Element{};
+		}
+	}
+}
+
+void Grid::ImportRows(int firstRow, int rowCount, const CellRecord* pRecords)
+{
+	for (int x{ firstRow }; x < firstRow + rowCount; ++x)
+	{
+		for (int y{}; y < m_GridInfo.columns; ++y, ++pRecords)
+		{
+			const Cell cell = GetCell(x, y);
+			if (cell == pRecords->cell && cell == EMPTY_CELL_STATE) continue;
+
+			// Same element (as far as anyone can tell) that only got updated, nothing here needs to wake up
+			if (cell != EMPTY_CELL_STATE && SetCellStamp(cell, 0) == SetCellStamp(pRecords->cell, 0))
+			{
+				*GetElementData(x, y) = pRecords->element;
+				StoreCell(GetCellIndex(x, y), pRecords->cell);
+				continue;
+			}
+
+			RemoveElementAt(x, y);
+			if (pRecords->cell == EMPTY_CELL_STATE) continue;
+
+			CellRandom random{ m_GridInfo.seed, m_TickCount, EDIT_RANDOM_STREAM, x + m_WorldFirstRow, y };
+			const ElementID id = m_pElementRegistry->AddElement(GetCellType(pRecords->cell), random);
+			if (id == EMPTY_CELL) continue;
+
+			*m_pElementRegistry->GetElementData(id) = pRecords->element;
+			const int index = GetWritableCellIndex(x, y);
+			m_Elements[index] = id;
+			StoreCell(index, pRecords->cell);
+			m_Colors[index] = ConvertCellColor(pRecords->cell, m_TypeColors.data());
+			MarkChunkAsDirty(x, y);
+		}
+	}
+}
+
+void Grid::UpdateChunksInParallel(const std::vector<int>& chunkIndices, const std::function<void(int)>& updateChunk, bool isClaimingCells)
+{
+	m_IsClaimingCells = isClaimingCells;
+
+	// One chunk per job, stealing evens out chunks that take much longer than others
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(chunkIndices.size()), 1, [&](int index, int threadIndex)
+		{
+			// A waiting thread can pick up jobs of another grid, so restore whatever it was marking into
+			DirtyChunkSet* pPreviousDirtyChunks = s_pThreadDirtyChunks;
+			ClaimStats* pPreviousClaimStats = s_pThreadClaimStats;
+			s_pThreadDirtyChunks = &m_ThreadDirtyChunks[threadIndex];
+			s_pThreadClaimStats = &m_ThreadClaimStats[threadIndex].stats;
+			updateChunk(chunkIndices[index]);
+			s_pThreadDirtyChunks = pPreviousDirtyChunks;
+			s_pThreadClaimStats = pPreviousClaimStats;
+		});
+
+	m_IsClaimingCells = false;
+	for (ThreadClaimStats& threadStats : m_ThreadClaimStats)
+	{
+		m_ClaimStats.claims += threadStats.stats.claims;
+		m_ClaimStats.conflicts += threadStats.stats.conflicts;
+		threadStats.stats = {};
+	}
+
+	for (DirtyChunkSet& dirtyChunks : m_ThreadDirtyChunks)
+	{
+		for (int chunkIndex : dirtyChunks.GetActiveChunks())
+		{
+			m_NextDirtyChunks.Mark(chunkIndex, dirtyChunks.GetRect(chunkIndex));
+		}
+		dirtyChunks.Clear();
+	}
+}
+
 void Grid::Render(Window* window)
 {
 	RenderElements(window);
@@ -151,6 +385,7 @@ void Grid::Render(Window* window)
 
 	if (ImGui::BeginListBox("##Elements", ImVec2(200, 200)))
 	{
+		auto typesLock = m_pElementRegistry->LockElementTypes();
 		const auto& elementTypes = m_pElementRegistry->GetElementTypes();
 
 		for (const auto& [name, definition] : elementTypes)
@@ -336,7 +571,9 @@ void Grid::Render(Window* window)
 			components["Lifetime"] = LifeTimeComp{ minLifeTime, maxLifeTime, spawnElementName };
 
 		// Add the new element to the registry
-		m_pElementRegistry->AddElementType({ elementName, hexColor, components });
+		GridCommand command{ GridCommand::Type::DefineElementType };
+		command.definition = { elementName, hexColor, components };
+		QueueCommand(std::move(command));
 
 		// Increment element count and reset inputs
 		elementCount++;
@@ -393,6 +630,8 @@ void Grid::RenderGrid(Window* window)
 {
 	static bool m_ShowDirtyChunks{};
 	static bool m_ShowChunks{};
+	static int m_UpdateScheduling{};
+	static int m_SimdLevel{ static_cast<int>(GetSimdLevel()) };
 
 	ImGui::Begin("Debug");
 
@@ -400,12 +639,34 @@ void Grid::RenderGrid(Window* window)
 
 	if (ImGui::Button("Clear Grid"))
 	{
-		ClearGrid();
+		QueueCommand({ GridCommand::Type::Clear });
 	}
 
 	ImGui::Checkbox("Show Chunks", &m_ShowChunks);
 	ImGui::Checkbox("Show Dirty Chunks", &m_ShowDirtyChunks);
 	ImGui::Checkbox("Brush Overriding", &m_BrushOverride);
+	if (ImGui::Combo("Update", &m_UpdateScheduling, "Serial\0Checkerboard\0Optimistic\0"))
+	{
+		GridCommand command{ GridCommand::Type::SetUpdateScheduling };
+		command.scheduling = static_cast<UpdateScheduling>(m_UpdateScheduling);
+		QueueCommand(std::move(command));
+	}
+	// Levels the CPU doesn't support snap back to the best one it does
+	if (ImGui::Combo("SIMD", &m_SimdLevel, "Scalar\0SSE4.2\0AVX2\0AVX-512\0"))
+	{
+		m_SimdLevel = static_cast<int>(SetSimdLevel(static_cast<SimdLevel>(m_SimdLevel)));
+	}
+	if (m_GridInfo.layout == GridLayout::Sparse)
+	{
+		std::lock_guard lock{ m_SnapshotMutex };
+		ImGui::Text("Allocated Chunks: %d / %d", m_Snapshots[m_FrontSnapshot].allocatedChunks, m_NumChunksX * m_NumChunksY);
+	}
+	if (m_UpdateScheduling == static_cast<int>(UpdateScheduling::Optimistic))
+	{
+		std::lock_guard lock{ m_SnapshotMutex };
+		const ClaimStats& claimStats = m_Snapshots[m_FrontSnapshot].claimStats;
+		ImGui::Text("Claim Conflicts: %u / %u", claimStats.conflicts, claimStats.claims);
+	}
 
 	ImGui::End();
 
@@ -429,22 +690,18 @@ void Grid::RenderGrid(Window* window)
 
 	if (m_ShowDirtyChunks)
 	{
-		for (int chunkX = 0; chunkX < m_NumChunksX; ++chunkX)
+		std::lock_guard lock{ m_SnapshotMutex };
+		for (const DirtyRect& dirtyRect : m_Snapshots[m_FrontSnapshot].dirtyRects)
 		{
-			for (int chunkY = 0; chunkY < m_NumChunksY; ++chunkY)
-			{
-				if (m_CurrentDirtyChunks[chunkX][chunkY])
-				{
-					SDL_SetRenderDrawColor(window->GetSDLRenderer(), 150, 150, 0, 255);
-					int startX = m_GridInfo.pos.x + chunkX * m_ChunkSize * m_GridInfo.cellSize;
-					int startY = m_GridInfo.pos.y + chunkY * m_ChunkSize * m_GridInfo.cellSize;
-					int width = m_ChunkSize * m_GridInfo.cellSize;
-					int height = m_ChunkSize * m_GridInfo.cellSize;
-
-					SDL_Rect chunkBounds = { startY, startX, width, height };
-					SDL_RenderDrawRect(window->GetSDLRenderer(), &chunkBounds);
-				}
-			}
+			// Draw the dirty rect of the chunk, the part that actually gets updated
+			SDL_SetRenderDrawColor(window->GetSDLRenderer(), 150, 150, 0, 255);
+			int startX = m_GridInfo.pos.x + dirtyRect.minX * m_GridInfo.cellSize;
+			int startY = m_GridInfo.pos.y + dirtyRect.minY * m_GridInfo.cellSize;
+			int width = (dirtyRect.maxY - dirtyRect.minY + 1) * m_GridInfo.cellSize;
+			int height = (dirtyRect.maxX - dirtyRect.minX + 1) * m_GridInfo.cellSize;
+
+			SDL_Rect chunkBounds = { startY, startX, width, height };
+			SDL_RenderDrawRect(window->GetSDLRenderer(), &chunkBounds);
 		}
 	}
 
@@ -461,83 +718,64 @@ void Grid::RenderGrid(Window* window)
 
 void Grid::RenderElements(Window* window) const
 {
-	static SDL_Texture* gridTexture = nullptr;
+	std::lock_guard lock{ m_SnapshotMutex };
+	const GridSnapshot& snapshot = m_Snapshots[m_FrontSnapshot];
+
+	// Update the texture only if a new snapshot got published, all of it once most chunks changed
+	const bool isNewSnapshot = snapshot.version != m_UploadedSnapshotVersion;
+	const int changedChunkCount = static_cast<int>(snapshot.uploadChunks.GetActiveChunks().size());
+	bool isFullUpload = isNewSnapshot && changedChunkCount * 2 > m_NumChunksX * m_NumChunksY;
 
-	// Create texture once if it doesn't exist
-	if (!gridTexture)
+	// Create texture once if it doesn't exist, it starts out without any of the pixels
+	if (!m_pGridTexture)
 	{
-		gridTexture = SDL_CreateTexture(
+		m_pGridTexture = SDL_CreateTexture(
 			window->GetSDLRenderer(),
 			SDL_PIXELFORMAT_RGB888,
 			SDL_TEXTUREACCESS_STREAMING,
 			this->GetColumns(),
 			this->GetRows()
 		);
+		isFullUpload = true;
 	}
 
-	// Check if any chunk is dirty
-	bool hasDirtyChunks = false;
-	for (int chunkX = 0; chunkX < m_NumChunksX; ++chunkX)
+	if (isFullUpload)
 	{
-		for (int chunkY = 0; chunkY < m_NumChunksY; ++chunkY)
-		{
-			if (m_CurrentDirtyChunks[chunkX][chunkY])
-			{
-				hasDirtyChunks = true;
-				break;
-			}
-		}
-		if (hasDirtyChunks) break;
-	}
+		// One lock of the whole texture beats a call per chunk then
+		m_UploadedSnapshotVersion = snapshot.version;
 
-	// Update the texture only if there are dirty chunks
-	if (hasDirtyChunks)
-	{
 		void* pixels;
 		int pitch;
-		SDL_LockTexture(gridTexture, nullptr, &pixels, &pitch);
+		SDL_LockTexture(m_pGridTexture, nullptr, &pixels, &pitch);
 
 		Uint32* pixelData = static_cast<Uint32*>(pixels);
 		const int PIXELS_PER_ROW = pitch / 4; // Uint32 (4 bytes per pixel)
 
-		// Update all pixels in the grid
-		for (int x = 0; x < this->GetRows(); ++x)
-		{
-			for (int y = 0; y < this->GetColumns(); ++y)
+		// The snapshot holds finished pixels, bands of a chunk high get copied in parallel.
+		// Every band only reads the snapshot and writes its own rows of the locked texture
+		const int bandCount = (this->GetRows() + m_ChunkSize - 1) / m_ChunkSize;
+		JobSystem::GetInstance().ParallelFor(bandCount, 1, [&](int band, int)
 			{
-				if (!IsEmpty(x, y))
-				{
-					const Element* element = GetElementData(x, y);
-					uint32_t baseColor = element->definition->color;
-
-					// Apply element's tint to color
-					uint8_t r = (baseColor >> 16) & 0xFF;
-					uint8_t g = (baseColor >> 8) & 0xFF;
-					uint8_t b = baseColor & 0xFF;
-
-					auto adjustColor = [tint = element->tint](uint8_t channel) -> uint8_t {
-						int newChannel = std::clamp(static_cast<int>(channel) + tint, 0, 255);
-						return static_cast<uint8_t>(newChannel);
-						};
-
-					r = adjustColor(r);
-					g = adjustColor(g);
-					b = adjustColor(b);
-
-					uint32_t color = (r << 16) | (g << 8) | b;
-
-					// Update pixel data
-					pixelData[x * PIXELS_PER_ROW + y] = color;
-				}
-				else
+				const int startX = band * m_ChunkSize;
+				const int endX = std::min(startX + m_ChunkSize, this->GetRows());
+				for (int x = startX; x < endX; ++x)
 				{
-					// Set empty cells to the background color
-					pixelData[x * PIXELS_PER_ROW + y] = 0x1A1A1A; // Black with full opacity
+					std::copy_n(&snapshot.pixels[x * this->GetColumns()], this->GetColumns(), pixelData + x * PIXELS_PER_ROW);
 				}
-			}
-		}
+			});
 
-		SDL_UnlockTexture(gridTexture);
+		SDL_UnlockTexture(m_pGridTexture);
+	}
+	else if (isNewSnapshot)
+	{
+		// Only the changed part of every chunk, in a quiet scene that is a few small rects instead of the whole grid
+		m_UploadedSnapshotVersion = snapshot.version;
+		for (int chunkIndex : snapshot.uploadChunks.GetActiveChunks())
+		{
+			const DirtyRect& rect = snapshot.uploadChunks.GetRect(chunkIndex);
+			const SDL_Rect textureRect{ rect.minY, rect.minX, rect.maxY - rect.minY + 1, rect.maxX - rect.minX + 1 };
+			SDL_UpdateTexture(m_pGridTexture, &textureRect, &snapshot.pixels[rect.minX * this->GetColumns() + rect.minY], this->GetColumns() * 4);
+		}
 	}
 
 	// Render the texture to the screen (always)
@@ -548,78 +786,259 @@ void Grid::RenderElements(Window* window) const
 		m_GridInfo.cellSize * this->GetRows()
 	};
 
-	SDL_RenderCopy(window->GetSDLRenderer(), gridTexture, nullptr, &destRect);
+	SDL_RenderCopy(window->GetSDLRenderer(), m_pGridTexture, nullptr, &destRect);
 }
 
 bool Grid::IsChunkDirty(int chunkX, int chunkY)
 {
 	if (chunkX >= 0 && chunkX < m_NumChunksX && chunkY >= 0 && chunkY < m_NumChunksY)
 	{
-		return m_CurrentDirtyChunks[chunkX][chunkY];
+		return m_CurrentDirtyChunks.IsDirty(GetChunkIndex(chunkX, chunkY));
 	}
 	return false;
 }
 
 void Grid::MarkChunkAsDirty(int x, int y)
+{
+	if (!IsWithinBounds(x, y)) return;
+
+	// The cell itself and its direct neighbours can be affected next update
+	const int minX = std::max(x - 1, 0);
+	const int minY = std::max(y - 1, 0);
+	const int maxX = std::min(x + 1, m_GridInfo.rows - 1);
+	const int maxY = std::min(y + 1, m_GridInfo.columns - 1);
+
+	DirtyChunkSet& dirtyChunks = s_pThreadDirtyChunks ? *s_pThreadDirtyChunks : m_NextDirtyChunks;
+
+	// Mark every chunk the expanded cell overlaps, with the part of it inside that chunk
+	for (int chunkX = minX / m_ChunkSize; chunkX <= maxX / m_ChunkSize; ++chunkX)
+	{
+		for (int chunkY = minY / m_ChunkSize; chunkY <= maxY / m_ChunkSize; ++chunkY)
+		{
+			const DirtyRect chunkBounds = GetChunkBounds(chunkX, chunkY);
+			dirtyChunks.Mark(GetChunkIndex(chunkX, chunkY), {
+				std::max(minX, chunkBounds.minX),
+				std::max(minY, chunkBounds.minY),
+				std::min(maxX, chunkBounds.maxX),
+				std::min(maxY, chunkBounds.maxY) });
+		}
+	}
+}
+
+void Grid::UnmarkChunkAsDirty(int x, int y)
 {
 	int chunkX = x / m_ChunkSize;
 	int chunkY = y / m_ChunkSize;
 
-	// Mark the main chunk dirty
 	if (chunkX >= 0 && chunkX < m_NumChunksX && chunkY >= 0 && chunkY < m_NumChunksY)
 	{
-		m_NextDirtyChunks[chunkX][chunkY] = true;
+		m_NextDirtyChunks.Unmark(GetChunkIndex(chunkX, chunkY));
 	}
+}
 
-	// Check and mark adjacent chunks
-	// Check if on the right border
-	if (x % m_ChunkSize == m_ChunkSize - 1 && chunkX + 1 < m_NumChunksX)
-	{
-		m_NextDirtyChunks[chunkX + 1][chunkY] = true;
-	}
+void Grid::ResetDirtyChunks()
+{
+	m_NextDirtyChunks.Clear();
+}
 
-	// Check if on the left border
-	if (x % m_ChunkSize == 0 && chunkX - 1 >= 0)
+DirtyRect Grid::GetChunkBounds(int chunkX, int chunkY) const
+{
+	const int startX = chunkX * m_ChunkSize;
+	const int startY = chunkY * m_ChunkSize;
+	return { startX, startY, std::min(startX + m_ChunkSize, m_GridInfo.rows) - 1, std::min(startY + m_ChunkSize, m_GridInfo.columns) - 1 };
+}
+
+bool Grid::IsChunkAllocated(int chunkIndex) const
+{
+	return m_GridInfo.layout != GridLayout::Sparse || m_ChunkBlocks[chunkIndex] != EMPTY_BLOCK;
+}
+
+int Grid::GetAllocatedChunkCount() const
+{
+	if (m_GridInfo.layout != GridLayout::Sparse) return m_NumChunksX * m_NumChunksY;
+	return static_cast<int>(m_BlockChunks.size()) - FIRST_CHUNK_BLOCK;
+}
+
+std::vector<int> Grid::CountElementTypes() const
+{
+	std::vector<int> typeCounts(m_pElementRegistry->GetElementTypeCount());
+	const SimdKernels& kernels = GetSimdKernels();
+	for (int x{}; x < m_GridInfo.rows; ++x)
 	{
-		m_NextDirtyChunks[chunkX - 1][chunkY] = true;
+		// The cells of a row are contiguous within a chunk in every layout, only the occupied ones get looked at
+		for (int startY{}; startY < m_GridInfo.columns; startY += m_ChunkSize)
+		{
+			const int width = std::min(m_ChunkSize, m_GridInfo.columns - startY);
+			const Cell* pCells = &m_Cells[GetCellIndex(x, startY)];
+			uint64_t occupied = kernels.findOccupiedCells(pCells, width);
+			typeCounts[EMPTY_TYPE] += width - std::popcount(occupied);
+			for (; occupied; occupied &= occupied - 1)
+			{
+				++typeCounts[GetCellType(pCells[std::countr_zero(occupied)])];
+			}
+		}
 	}
+	return typeCounts;
+}
 
-	// Check if on the bottom border
-	if (y % m_ChunkSize == m_ChunkSize - 1 && chunkY + 1 < m_NumChunksY)
+inline int Grid::GetCellIndex(int x, int y) const
+{
+	if (m_GridInfo.layout == GridLayout::RowMajor)
 	{
-		m_NextDirtyChunks[chunkX][chunkY + 1] = true;
+		return (x + m_BorderSize) * m_RowStride + (y + m_BorderSize);
 	}
 
-	// Check if on the top border
-	if (y % m_ChunkSize == 0 && chunkY - 1 >= 0)
+	if (!IsWithinBounds(x, y)) return BORDER_BLOCK * m_CellsPerChunk;
+	const int chunkIndex = GetChunkIndex(x / m_ChunkSize, y / m_ChunkSize);
+	const int block = m_GridInfo.layout == GridLayout::Tiled ? FIRST_CHUNK_BLOCK + chunkIndex : m_ChunkBlocks[chunkIndex];
+	return block * m_CellsPerChunk + GetChunkCellIndex(x, y);
+}
+
+// Index of a cell inside its chunk's block, row-major within the chunk
+inline int Grid::GetChunkCellIndex(int x, int y) const
+{
+	return (x % m_ChunkSize) * m_ChunkSize + y % m_ChunkSize;
+}
+
+// Same as GetCellIndex, but makes sure a sparse chunk has its own block before it gets written to
+inline int Grid::GetWritableCellIndex(int x, int y)
+{
+	if (m_GridInfo.layout == GridLayout::Sparse)
 	{
-		m_NextDirtyChunks[chunkX][chunkY - 1] = true;
+		const int chunkIndex = GetChunkIndex(x / m_ChunkSize, y / m_ChunkSize);
+		if (m_ChunkBlocks[chunkIndex] == EMPTY_BLOCK)
+		{
+			AllocateChunk(chunkIndex);
+		}
 	}
+	return GetCellIndex(x, y);
 }
 
+void Grid::AllocateChunk(int chunkIndex)
+{
+	m_ChunkBlocks[chunkIndex] = static_cast<int>(m_BlockChunks.size());
+	m_BlockChunks.push_back(chunkIndex);
+	m_Cells.resize(m_Cells.size() + m_CellsPerChunk, EMPTY_CELL_STATE);
+	m_Elements.resize(m_Elements.size() + m_CellsPerChunk, EMPTY_CELL);
+	m_Colors.resize(m_Colors.size() + m_CellsPerChunk, BACKGROUND_COLOR);
+}
 
-void Grid::UnmarkChunkAsDirty(int x, int y)
+void Grid::ReleaseChunk(int chunkIndex)
 {
-	int chunkX = x / m_ChunkSize;
-	int chunkY = y / m_ChunkSize;
+	const int block = m_ChunkBlocks[chunkIndex];
+	const int lastBlock = static_cast<int>(m_BlockChunks.size()) - 1;
 
-	if (chunkX >= 0 && chunkX < m_NumChunksX && chunkY >= 0 && chunkY < m_NumChunksY)
+	// Move the last block into the freed one so the allocated blocks stay packed
+	if (block != lastBlock)
 	{
-		m_NextDirtyChunks[chunkX][chunkY] = false;
+		std::copy_n(m_Cells.begin() + lastBlock * m_CellsPerChunk, m_CellsPerChunk, m_Cells.begin() + block * m_CellsPerChunk);
+		std::copy_n(m_Elements.begin() + lastBlock * m_CellsPerChunk, m_CellsPerChunk, m_Elements.begin() + block * m_CellsPerChunk);
+		std::copy_n(m_Colors.begin() + lastBlock * m_CellsPerChunk, m_CellsPerChunk, m_Colors.begin() + block * m_CellsPerChunk);
+		m_BlockChunks[block] = m_BlockChunks[lastBlock];
+		m_ChunkBlocks[m_BlockChunks[block]] = block;
 	}
+
+	m_ChunkBlocks[chunkIndex] = EMPTY_BLOCK;
+	m_BlockChunks.pop_back();
+	m_Cells.resize(static_cast<size_t>(lastBlock) * m_CellsPerChunk);
+	m_Elements.resize(m_Cells.size());
+	m_Colors.resize(m_Cells.size());
 }
 
-void Grid::ResetDirtyChunks()
+void Grid::PreallocateChunkNeighbours()
+{
+	// Nothing reaches further than the direct neighbours of a chunk during a parallel update
+	for (int chunkIndex : m_CurrentDirtyChunks.GetActiveChunks())
+	{
+		const int chunkX = chunkIndex / m_NumChunksY;
+		const int chunkY = chunkIndex % m_NumChunksY;
+		for (int neighbourX = std::max(chunkX - 1, 0); neighbourX <= std::min(chunkX + 1, m_NumChunksX - 1); ++neighbourX)
+		{
+			for (int neighbourY = std::max(chunkY - 1, 0); neighbourY <= std::min(chunkY + 1, m_NumChunksY - 1); ++neighbourY)
+			{
+				const int neighbourIndex = GetChunkIndex(neighbourX, neighbourY);
+				if (m_ChunkBlocks[neighbourIndex] == EMPTY_BLOCK)
+				{
+					AllocateChunk(neighbourIndex);
+					m_PreallocatedChunks.push_back(neighbourIndex);
+				}
+			}
+		}
+	}
+}
+
+void Grid::ReleaseEmptyChunks()
 {
-	for (auto& row : m_NextDirtyChunks)
+	// Only chunks that changed during the last update can have become empty
+	std::vector<int> candidates = m_PreallocatedChunks;
+	for (int chunkIndex : m_CurrentDirtyChunks.GetActiveChunks())
+	{
+		if (m_ChunkBlocks[chunkIndex] != EMPTY_BLOCK) candidates.push_back(chunkIndex);
+	}
+	m_PreallocatedChunks.clear();
+
+	// Scanning the blocks is the expensive part and only reads, releasing them moves blocks around
+	std::vector<uint8_t> isEmpty(candidates.size());
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(candidates.size()), 16, [&](int index, int)
+		{
+			isEmpty[index] = GetSimdKernels().areCellsEmpty(&m_Cells[m_ChunkBlocks[candidates[index]] * m_CellsPerChunk], m_CellsPerChunk);
+		});
+
+	for (size_t i{}; i < candidates.size(); ++i)
+	{
+		// A chunk can be in both lists
+		if (isEmpty[i] && m_ChunkBlocks[candidates[i]] != EMPTY_BLOCK)
+		{
+			ReleaseChunk(candidates[i]);
+		}
+	}
+
+	// Give the memory back after a large part of the world got cleared
+	if (m_Cells.capacity() > 2 * m_Cells.size())
 	{
-		std::fill(row.begin(), row.end(), false);
+		m_Cells.shrink_to_fit();
+		m_Elements.shrink_to_fit();
+		m_Colors.shrink_to_fit();
 	}
 }
 
+inline Cell Grid::LoadCell(int index) const
+{
+	return std::atomic_ref<Cell>{ const_cast<Cell&>(m_Cells[index]) }.load(std::memory_order_relaxed);
+}
+
+inline void Grid::StoreCell(int index, Cell cell)
+{
+	// Releases the element handle written before it to the next thread claiming the cell
+	std::atomic_ref<Cell>{ m_Cells[index] }.store(cell, std::memory_order_release);
+}
+
+inline Cell Grid::GetCell(int x, int y) const
+{
+	return LoadCell(GetCellIndex(x, y));
+}
+
+inline Cell Grid::GetCell(const glm::ivec2& pos) const
+{
+	return GetCell(pos.x, pos.y);
+}
+
+inline void Grid::SetCell(int x, int y, Cell cell)
+{
+	const int index = GetCellIndex(x, y);
+	// Only written by the thread holding the cell, which keeps it until it releases it
+	StoreCell(index, m_IsClaimingCells ? cell | (LoadCell(index) & CLAIMED_CELL_BIT) : cell);
+}
+
+void Grid::RecolorCell(int x, int y)
+{
+	const int index = GetCellIndex(x, y);
+	m_Colors[index] = ConvertCellColor(LoadCell(index), m_TypeColors.data());
+}
+
 inline ElementID Grid::GetElementID(int x, int y) const
 {
-	return m_Elements[x][y];
+	return m_Elements[GetCellIndex(x, y)];
 }
 
 ElementID Grid::GetElementID(const glm::ivec2& pos) const
@@ -630,7 +1049,7 @@ ElementID Grid::GetElementID(const glm::ivec2& pos) const
 inline Element* Grid::GetElementData(int x, int y) const
 {
 	ElementID id = GetElementID(x, y);
-	if (id == EMPTY_CELL) return nullptr;
+	if (id == EMPTY_CELL || id == BORDER_CELL) return nullptr;
 	return m_pElementRegistry->GetElementData(id);
 }
 
@@ -651,7 +1070,7 @@ inline bool Grid::IsWithinBounds(const glm::ivec2& pos) const
 
 inline bool Grid::IsEmpty(int x, int y) const
 {
-	return GetElementID(x, y) == EMPTY_CELL;
+	return GetCell(x, y) == EMPTY_CELL_STATE;
 }
 
 inline bool Grid::IsEmpty(const glm::ivec2& pos) const
@@ -659,76 +1078,114 @@ inline bool Grid::IsEmpty(const glm::ivec2& pos) const
 	return IsEmpty(pos.x, pos.y);
 }
 
-inline bool Grid::IsEvenFrame() const
+inline uint64_t Grid::FindOccupiedCells(int x, int minY, int maxY) const
 {
-	return m_FrameCounter % 2 == 0;
+	// The span is contiguous in every layout. In the optimistic update other threads claim and move cells
+	// of the span while it gets scanned, plain vector loads would race with their atomic stores, so every
+	// cell is loaded on its own then. A cell that changes right after its load is caught by the claim.
+	const int index = GetCellIndex(x, minY);
+	const int count = maxY - minY + 1;
+	if (!m_IsClaimingCells) return GetSimdKernels().findOccupiedCells(&m_Cells[index], count);
+
+	uint64_t occupied{};
+	for (int i{}; i < count; ++i)
+	{
+		occupied |= static_cast<uint64_t>(LoadCell(index + i) != EMPTY_CELL_STATE) << i;
+	}
+	return occupied;
 }
 
-void Grid::AddElementBrushed(int x, int y, const std::string& elementTypeName, bool override, float spawnChance)
+inline bool Grid::IsEvenFrame() const
 {
-	float radius = m_BrushSize - 0.5f; // Fractional brush size
+	return m_TickCount % 2 == 0;
+}
 
-	// Clamp spawnChance between 0 and 1 for safety
-	spawnChance = std::clamp(spawnChance, 0.0f, 1.0f);
+void Grid::AddElementBrushed(int x, int y, int brushSize, const std::string& elementTypeName, bool override, float spawnChance)
+{
+	AddElementsBrushed({ { x, y } }, brushSize, elementTypeName, override, spawnChance);
+}
 
-	// Calculate the bounding box of the circle
-	int minX = static_cast<int>(std::floor(x - radius));
-	int maxX = static_cast<int>(std::ceil(x + radius));
-	int minY = static_cast<int>(std::floor(y - radius));
-	int maxY = static_cast<int>(std::ceil(y + radius));
+void Grid::AddElementAt(int x, int y, const std::string& elementTypeName)
+{
+	// Keyed on the world row, so the element rolls the same whichever band of a split world places it
+	CellRandom random{ m_GridInfo.seed, m_TickCount, EDIT_RANDOM_STREAM + m_EditCount, x + m_WorldFirstRow, y };
+	AddElementAt(x, y, elementTypeName, random);
+}
 
-	// Iterate over all cells in the bounding box
-	for (int i = minX; i <= maxX; ++i)
+void Grid::AddElementAt(int x, int y, const std::string& elementTypeName, CellRandom& random)
+{
+	if (IsWithinBounds(x, y) && IsEmpty(x, y))
 	{
-		for (int j = minY; j <= maxY; ++j)
-		{
-			// Check if the cell is within the circle
-			float distance = std::sqrt((i - x) * (i - x) + (j - y) * (j - y));
-			if (distance <= radius && IsWithinBounds(i, j) && (override ? true : IsEmpty(i, j)))
-			{
-				// Roll a random chance to skip adding an element
-				if (static_cast<float>(rand()) / RAND_MAX > spawnChance)
-				{
-					continue; // Skip this cell
-				}
+		const ElementDefinition* definition = m_pElementRegistry->GetElementType(elementTypeName);
+		assert(definition && "Element type not found! Ensure the type is correctly registered.");
 
-				// Handle element addition/removal
-				if (override) RemoveElementAt(i, j);
-				AddElementAt(i, j, elementTypeName);
-			}
+		// If assertions are disabled
+		if (!definition)
+		{
+			std::cout << "Warning: Element \"" + elementTypeName + "\" not found!\n";
+			return;
 		}
+
+		MarkChunkAsDirty(x, y);
+
+		// Generate a random tint adjustment (-15 to +15)
+		int8_t randomTint = static_cast<int8_t>(random.NextInt(-15, 15));
+
+		ElementID id = m_pElementRegistry->AddElement(definition->typeID, random);
+		if (id == EMPTY_CELL) return;
+
+		// Stamp it with the previous tick so it gets updated on the next one
+		const int index = GetWritableCellIndex(x, y);
+		const Cell cell = MakeCell(definition->typeID, randomTint);
+		m_Elements[index] = id;
+		m_Colors[index] = ConvertCellColor(cell, m_TypeColors.data());
+		StoreCell(index, SetCellStamp(cell, static_cast<uint8_t>(m_TickCount - 1)));
 	}
 }
 
-void Grid::AddElementAt(int x, int y, const std::string& elementTypeName)
+void Grid::RemoveElementBrushed(int x, int y, int brushSize)
 {
-	if (IsWithinBounds(x, y) && IsEmpty(x, y))
+	RemoveElementsBrushed({ { x, y } }, brushSize);
+}
+
+void Grid::AddElementsBrushed(const std::vector<glm::ivec2>& stamps, int brushSize, const std::string& elementTypeName, bool override, float spawnChance)
+{
+	spawnChance = std::clamp(spawnChance, 0.0f, 1.0f);
+
+	const DirtyRect bounds = RasterizeStroke(stamps, brushSize);
+	const int width = bounds.maxY - bounds.minY + 1;
+	const uint32_t editIndex = m_EditCount++;
+
+	for (int i = bounds.minX; i <= bounds.maxX; ++i)
 	{
-		MarkChunkAsDirty(x, y);
+		const uint8_t* coverageRow = &m_StrokeCoverage[(i - bounds.minX) * width];
+		for (int j = bounds.minY; j <= bounds.maxY; ++j)
+		{
+			const uint8_t hits = coverageRow[j - bounds.minY];
+			if (hits == 0 || !(override || IsEmpty(i, j))) continue;
+
+			// Stamped one by one every stamp rolls on its own, so the cell gets filled if any of them succeeds
+			const float chance = hits == 1 ? spawnChance : 1.f - std::pow(1.f - spawnChance, static_cast<float>(hits));
+			CellRandom random{ m_GridInfo.seed, m_TickCount, EDIT_RANDOM_STREAM + editIndex, i + m_WorldFirstRow, j };
+			if (random.NextFloat() > chance) continue;
 
-		ElementID id = m_pElementRegistry->AddElement(elementTypeName);
-		m_Elements[x][y] = id;
+			if (override) RemoveElementAt(i, j);
+			AddElementAt(i, j, elementTypeName, random);
+		}
 	}
 }
 
-void Grid::RemoveElementBrushed(int x, int y)
+void Grid::RemoveElementsBrushed(const std::vector<glm::ivec2>& stamps, int brushSize)
 {
-	float radius = m_BrushSize - 0.5f; // Fractional brush size
-
-	// Calculate the bounding box of the circle
-	int minX = static_cast<int>(std::floor(x - radius));
-	int maxX = static_cast<int>(std::ceil(x + radius));
-	int minY = static_cast<int>(std::floor(y - radius));
-	int maxY = static_cast<int>(std::ceil(y + radius));
+	const DirtyRect bounds = RasterizeStroke(stamps, brushSize);
+	const int width = bounds.maxY - bounds.minY + 1;
 
-	// Iterate over all cells in the bounding box
-	for (int i = minX; i <= maxX; ++i)
+	for (int i = bounds.minX; i <= bounds.maxX; ++i)
 	{
-		for (int j = minY; j <= maxY; ++j)
+		const uint8_t* coverageRow = &m_StrokeCoverage[(i - bounds.minX) * width];
+		for (int j = bounds.minY; j <= bounds.maxY; ++j)
 		{
-			// Check if the cell is within the circle
-			float distance = std::sqrt((i - x) * (i - x) + (j - y) * (j - y));
-			if (distance <= radius && IsWithinBounds(i, j) && !IsEmpty(i, j))
+			if (coverageRow[j - bounds.minY] != 0 && !IsEmpty(i, j))
 			{
 				RemoveElementAt(i, j);
 			}
@@ -736,6 +1193,43 @@ void Grid::RemoveElementBrushed(int x, int y)
 	}
 }
 
+DirtyRect Grid::RasterizeStroke(const std::vector<glm::ivec2>& stamps, int brushSize)
+{
+	const float radius = brushSize - 0.5f; // Fractional brush size
+	if (stamps.empty() || radius < 0.f) return { 0, 0, -1, -1 };
+	const int reach = static_cast<int>(std::ceil(radius));
+
+	// Bounds of the whole stroke, clipped to the grid (an empty rect if it lies outside)
+	DirtyRect bounds{ GetRows(), GetColumns(), -1, -1 };
+	for (const glm::ivec2& stamp : stamps)
+	{
+		bounds.minX = std::min(bounds.minX, stamp.x - reach);
+		bounds.minY = std::min(bounds.minY, stamp.y - reach);
+		bounds.maxX = std::max(bounds.maxX, stamp.x + reach);
+		bounds.maxY = std::max(bounds.maxY, stamp.y + reach);
+	}
+	bounds = { std::max(bounds.minX, 0), std::max(bounds.minY, 0), std::min(bounds.maxX, GetRows() - 1), std::min(bounds.maxY, GetColumns() - 1) };
+	if (bounds.minX > bounds.maxX || bounds.minY > bounds.maxY) return { 0, 0, -1, -1 };
+
+	const int width = bounds.maxY - bounds.minY + 1;
+	m_StrokeCoverage.assign(static_cast<size_t>(bounds.maxX - bounds.minX + 1) * width, 0);
+
+	const SimdKernels& kernels = GetSimdKernels();
+	for (const glm::ivec2& stamp : stamps)
+	{
+		const int minX = std::max(stamp.x - reach, bounds.minX);
+		const int maxX = std::min(stamp.x + reach, bounds.maxX);
+		const int minY = std::max(stamp.y - reach, bounds.minY);
+		const int maxY = std::min(stamp.y + reach, bounds.maxY);
+		for (int i = minX; i <= maxX; ++i)
+		{
+			uint8_t* coverageRow = &m_StrokeCoverage[(i - bounds.minX) * width];
+			kernels.addStampCoverage(coverageRow + (minY - bounds.minY), maxY - minY + 1, minY - stamp.y, (i - stamp.x) * (i - stamp.x), radius * radius);
+		}
+	}
+	return bounds;
+}
+
 void Grid::RemoveElementAt(int x, int y)
 {
 	if (IsWithinBounds(x, y) && !IsEmpty(x, y))
@@ -743,9 +1237,13 @@ void Grid::RemoveElementAt(int x, int y)
 		MarkChunkAsDirty(x, y);
 
 
-		ElementID id = m_Elements[x][y];
-		m_pElementRegistry->RemoveElement(id);
-		m_Elements[x][y] = EMPTY_CELL;
+		const int index = GetCellIndex(x, y);
+		m_pElementRegistry->RemoveElement(m_Elements[index]);
+		m_Elements[index] = EMPTY_CELL;
+		m_Colors[index] = BACKGROUND_COLOR;
+		// Also ends the hold if this is the element being updated
+		StoreCell(index, EMPTY_CELL_STATE);
+		if (index == s_HeldCellIndex) s_HeldCellIndex = -1;
 	}
 }
 
@@ -772,27 +1270,301 @@ void Grid::MoveElement(int x, int y, int newX, int newY)
 	MarkChunkAsDirty(x, y);
 	MarkChunkAsDirty(newX, newY);
 
-	m_Elements[newX][newY] = m_Elements[x][y];
-	m_Elements[x][y] = EMPTY_CELL;
+	const int index = GetCellIndex(x, y);
+	const int newIndex = GetWritableCellIndex(newX, newY);
+	m_Cells[newIndex] = m_Cells[index];
+	m_Elements[newIndex] = m_Elements[index];
+	m_Colors[newIndex] = m_Colors[index];
+	m_Cells[index] = EMPTY_CELL_STATE;
+	m_Elements[index] = EMPTY_CELL;
+	m_Colors[index] = BACKGROUND_COLOR;
 }
 
-void Grid::SwapElements(int x, int y, int newX, int newY)
+bool Grid::SwapElements(int x, int y, int newX, int newY, Cell newCell)
 {
-	if (x == newX && y == newY) return;
+	if (x == newX && y == newY) return true;
 
 	MarkChunkAsDirty(x, y);
 	MarkChunkAsDirty(newX, newY);
 
-	std::swap(m_Elements[x][y], m_Elements[newX][newY]);
+	// Nothing to exchange, and no reason to allocate their chunks
+	if (IsEmpty(x, y) && IsEmpty(newX, newY)) return true;
+
+	const int index = GetWritableCellIndex(x, y);
+	const int newIndex = GetWritableCellIndex(newX, newY);
+	if (m_IsClaimingCells) return SwapClaimedCells(index, newIndex, newCell);
+
+	std::swap(m_Cells[index], m_Cells[newIndex]);
+	std::swap(m_Elements[index], m_Elements[newIndex]);
+	std::swap(m_Colors[index], m_Colors[newIndex]);
+	return true;
+}
+
+bool Grid::SwapClaimedCells(int index, int newIndex, Cell newCell)
+{
+	// Claim both cells, except the one holding the element this thread updates.
+	// A destination that changed since the caller decided on the move, or a cell claimed by another thread,
+	// ends the swap. Both chunks are already marked dirty so the element tries again next tick, retrying now
+	// would act on a decision made for a neighbour that isn't there anymore.
+	const Cell cell = LoadCell(index);
+	if (newIndex == s_HeldCellIndex) newCell = LoadCell(newIndex);
+	if (index != s_HeldCellIndex && !TryClaimCell(index, cell)) return false;
+	if (newIndex != s_HeldCellIndex && !TryClaimCell(newIndex, newCell))
+	{
+		if (index != s_HeldCellIndex) StoreCell(index, cell);
+		return false;
+	}
+
+	std::swap(m_Elements[index], m_Elements[newIndex]);
+	std::swap(m_Colors[index], m_Colors[newIndex]);
+
+	// The held element takes its claim along, the claims taken for the swap end with it
+	Cell movedCell = cell & ~CLAIMED_CELL_BIT;
+	Cell movedNewCell = newCell & ~CLAIMED_CELL_BIT;
+	if (s_HeldCellIndex == index)
+	{
+		movedCell |= CLAIMED_CELL_BIT;
+		s_HeldCellIndex = newIndex;
+	}
+	else if (s_HeldCellIndex == newIndex)
+	{
+		movedNewCell |= CLAIMED_CELL_BIT;
+		s_HeldCellIndex = index;
+	}
+	StoreCell(index, movedNewCell);
+	StoreCell(newIndex, movedCell);
+	return true;
+}
+
+bool Grid::TryClaimCell(int index, Cell expected)
+{
+	++s_pThreadClaimStats->claims;
+
+	Cell value = expected;
+	if ((expected & CLAIMED_CELL_BIT) == 0 &&
+		std::atomic_ref<Cell>{ m_Cells[index] }.compare_exchange_strong(value, expected | CLAIMED_CELL_BIT, std::memory_order_acquire, std::memory_order_relaxed))
+	{
+		return true;
+	}
+
+	++s_pThreadClaimStats->conflicts;
+	return false;
+}
+
+bool Grid::HoldElement(int x, int y, Cell expected)
+{
+	if (!m_IsClaimingCells) return true;
+	// An empty cell has no element to update, holding it would stamp it and leave an invisible occupied cell
+	if (expected == EMPTY_CELL_STATE) return false;
+
+	const int index = GetCellIndex(x, y);
+	if (!TryClaimCell(index, expected))
+	{
+		// Whoever has it might let go without updating the element, so look at it again next tick
+		MarkChunkAsDirty(x, y);
+		return false;
+	}
+	s_HeldCellIndex = index;
+	return true;
+}
+
+void Grid::ReleaseHeldElement()
+{
+	if (s_HeldCellIndex < 0) return;
+
+	// Removing the held element ends the hold, so the cell still holds an element here
+	const Cell cell = LoadCell(s_HeldCellIndex);
+	assert(GetCellType(cell) != EMPTY_TYPE && "The held cell lost its element without ending the hold!");
+	StoreCell(s_HeldCellIndex, cell & ~CLAIMED_CELL_BIT);
+	s_HeldCellIndex = -1;
+}
+
+bool Grid::ClaimCell(int x, int y, Cell expected)
+{
+	if (!m_IsClaimingCells) return true;
+
+	return TryClaimCell(GetCellIndex(x, y), expected);
+}
+
+void Grid::ReleaseCell(int x, int y)
+{
+	if (!m_IsClaimingCells) return;
+
+	const int index = GetCellIndex(x, y);
+	StoreCell(index, LoadCell(index) & ~CLAIMED_CELL_BIT);
 }
 
 void Grid::ClearGrid()
 {
-	for (int x{}; x < this->GetRows(); ++x)
+	for (int chunkX{}; chunkX < m_NumChunksX; ++chunkX)
 	{
-		for (int y{}; y < this->GetColumns(); ++y)
+		for (int chunkY{}; chunkY < m_NumChunksY; ++chunkY)
 		{
-			RemoveElementAt(x, y);
+			if (!IsChunkAllocated(GetChunkIndex(chunkX, chunkY))) continue;
+
+			const DirtyRect bounds = GetChunkBounds(chunkX, chunkY);
+			for (int x{ bounds.minX }; x <= bounds.maxX; ++x)
+			{
+				for (int y{ bounds.minY }; y <= bounds.maxY; ++y)
+				{
+					RemoveElementAt(x, y);
+				}
+			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+void Grid::QueueCommand(GridCommand&& command)
+{
+	if (!m_QueuedCommands.TryPush(std::move(command)))
+	{
+		// Only happens when the simulation stopped draining, one stroke per frame never gets close
+		std::cout << "Warning: Grid command queue is full, command dropped!\n";
+	}
+}
+
+void Grid::ApplyCommands()
+{
+	GridCommand command{};
+	while (m_QueuedCommands.TryPop(command))
+	{
+		m_DrainedCommands.push_back(std::move(command));
+	}
+
+	for (size_t i{}; i < m_DrainedCommands.size(); ++i)
+	{
+		// Strokes of several frames piled up behind a slow step get stamped as one
+		GridCommand& current = m_DrainedCommands[i];
+		while (i + 1 < m_DrainedCommands.size() && current.CanMergeWith(m_DrainedCommands[i + 1]))
+		{
+			const std::vector<glm::ivec2>& nextStamps = m_DrainedCommands[++i].stamps;
+			current.stamps.insert(current.stamps.end(), nextStamps.begin(), nextStamps.end());
+		}
+		ApplyCommand(current);
+	}
+	m_DrainedCommands.clear();
+}
+
+void Grid::ApplyCommand(const GridCommand& command)
+{
+	switch (command.type)
+	{
+	case GridCommand::Type::Brush:
+		AddElementsBrushed(command.stamps, command.brushSize, command.elementTypeName, command.override, command.spawnChance);
+		break;
+	case GridCommand::Type::Erase:
+		RemoveElementsBrushed(command.stamps, command.brushSize);
+		break;
+	case GridCommand::Type::Clear:
+		ClearGrid();
+		break;
+	case GridCommand::Type::DefineElementType:
+		m_pElementRegistry->AddElementType(command.definition);
+		RefreshTypeColors();
+		break;
+	case GridCommand::Type::SetUpdateScheduling:
+		SetUpdateScheduling(command.scheduling);
+		break;
+	}
+}
+
+void Grid::RefreshTypeColors()
+{
+	// A new type has no cells yet, only a changed color of a known type needs the plane converted again
+	bool isColorChanged{};
+	m_TypeColors[EMPTY_TYPE] = BACKGROUND_COLOR;
+	const size_t typeCount = m_pElementRegistry->GetElementTypeCount();
+	for (size_t typeID{ EMPTY_TYPE + 1 }; typeID < typeCount; ++typeID)
+	{
+		const uint32_t color = m_pElementRegistry->GetElementType(static_cast<ElementTypeID>(typeID))->color;
+		isColorChanged |= typeID < m_TypeColorCount && color != m_TypeColors[typeID];
+		m_TypeColors[typeID] = color;
+	}
+	m_TypeColorCount = typeCount;
+	if (!isColorChanged) return;
+
+	// Types only change through the UI, converting every cell again is cheap enough then
+	ConvertCellColors(m_Cells.data(), static_cast<int>(m_Cells.size()), m_TypeColors.data(), m_Colors.data());
+	for (int chunkX{}; chunkX < m_NumChunksX; ++chunkX)
+	{
+		for (int chunkY{}; chunkY < m_NumChunksY; ++chunkY)
+		{
+			const int chunkIndex = GetChunkIndex(chunkX, chunkY);
+			const DirtyRect bounds = GetChunkBounds(chunkX, chunkY);
+			for (GridSnapshot& snapshot : m_Snapshots)
+			{
+				snapshot.staleChunks.Mark(chunkIndex, bounds);
+			}
+			m_UnpublishedChunks.Mark(chunkIndex, bounds);
+		}
+	}
+}
+
+void Grid::PublishSnapshot()
+{
+	// Everything changed since the last publish: the last step's chunks (if there was one) and edits since
+	auto addChanges = [&](const DirtyChunkSet& changedChunks)
+		{
+			for (int chunkIndex : changedChunks.GetActiveChunks())
+			{
+				const DirtyRect& rect = changedChunks.GetRect(chunkIndex);
+				m_UnpublishedChunks.Mark(chunkIndex, rect);
+				for (GridSnapshot& snapshot : m_Snapshots)
+				{
+					snapshot.staleChunks.Mark(chunkIndex, rect);
+				}
+			}
+		};
+	if (m_TickCount != m_PublishedTickCount)
+	{
+		addChanges(m_CurrentDirtyChunks);
+		m_PublishedTickCount = m_TickCount;
+	}
+	addChanges(m_NextDirtyChunks);
+
+	// The renderer only ever reads the front snapshot, so the back one can be filled without holding the lock
+	GridSnapshot& snapshot = m_Snapshots[1 - m_FrontSnapshot];
+	for (int chunkIndex : snapshot.staleChunks.GetActiveChunks())
+	{
+		const DirtyRect& rect = snapshot.staleChunks.GetRect(chunkIndex);
+		const int width = rect.maxY - rect.minY + 1;
+		for (int x{ rect.minX }; x <= rect.maxX; ++x)
+		{
+			const int index = GetCellIndex(x, rect.minY);
+			std::copy_n(&m_Cells[index], width, &snapshot.cells[x * m_GridInfo.columns + rect.minY]);
+			std::copy_n(&m_Colors[index], width, &snapshot.pixels[x * m_GridInfo.columns + rect.minY]);
+		}
+	}
+	snapshot.staleChunks.Clear();
+
+	snapshot.dirtyRects.clear();
+	for (int chunkIndex : m_UnpublishedChunks.GetActiveChunks())
+	{
+		snapshot.dirtyRects.push_back(m_UnpublishedChunks.GetRect(chunkIndex));
+	}
+	snapshot.allocatedChunks = GetAllocatedChunkCount();
+	snapshot.claimStats = m_ClaimStats;
+
+	// Never wait for the renderer, if it is still reading the front snapshot this one just gets refreshed next step
+	std::unique_lock lock{ m_SnapshotMutex, std::try_to_lock };
+	if (!lock.owns_lock()) return;
+
+	// The renderer may have skipped the front snapshot, its changes then still have to be uploaded with this one
+	const GridSnapshot& frontSnapshot = m_Snapshots[m_FrontSnapshot];
+	snapshot.uploadChunks.Clear();
+	if (frontSnapshot.version != m_UploadedSnapshotVersion)
+	{
+		for (int chunkIndex : frontSnapshot.uploadChunks.GetActiveChunks())
+		{
+			snapshot.uploadChunks.Mark(chunkIndex, frontSnapshot.uploadChunks.GetRect(chunkIndex));
+		}
+	}
+	for (int chunkIndex : m_UnpublishedChunks.GetActiveChunks())
+	{
+		snapshot.uploadChunks.Mark(chunkIndex, m_UnpublishedChunks.GetRect(chunkIndex));
+	}
+	m_UnpublishedChunks.Clear();
+
+	snapshot.version = ++m_SnapshotVersion;
+	m_FrontSnapshot = 1 - m_FrontSnapshot;
+}
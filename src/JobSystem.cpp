@@ -0,0 +1,168 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+
+// Deque the calling thread owns, -1 until it is assigned
+static thread_local int s_ThreadIndex{ -1 };
+
+JobSystem::JobSystem()
+{
+	const int workerCount = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+
+	// The first queues belong to outside threads, the workers come after them
+	m_Queues.reserve(MAX_OUTSIDE_THREADS + workerCount);
+	for (int i{}; i < MAX_OUTSIDE_THREADS + workerCount; ++i)
+	{
+		m_Queues.emplace_back(std::make_unique<WorkQueue>());
+	}
+
+	m_Workers.reserve(workerCount);
+	for (int i{}; i < workerCount; ++i)
+	{
+		m_Workers.emplace_back(&JobSystem::WorkerLoop, this, MAX_OUTSIDE_THREADS + i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard lock{ m_SleepMutex };
+		m_IsStopping = true;
+	}
+	m_JobAvailable.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+int JobSystem::GetThreadIndex()
+{
+	if (s_ThreadIndex < 0)
+	{
+		s_ThreadIndex = m_OutsideThreadCount.fetch_add(1, std::memory_order_relaxed);
+		assert(s_ThreadIndex < MAX_OUTSIDE_THREADS && "Too many threads outside the job system submit work!");
+		s_ThreadIndex = std::min(s_ThreadIndex, MAX_OUTSIDE_THREADS - 1);
+	}
+	return s_ThreadIndex;
+}
+
+void JobSystem::Submit(Job job, JobCounter& counter)
+{
+	Push(GetThreadIndex(), { std::move(job), &counter });
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+	const int threadIndex = GetThreadIndex();
+	while (counter.load(std::memory_order_acquire) > 0)
+	{
+		if (!TryRunJob(threadIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::ParallelFor(int count, int batchSize, const std::function<void(int, int)>& func)
+{
+	if (count <= 0) return;
+	batchSize = std::max(batchSize, 1);
+	const int batchCount = (count + batchSize - 1) / batchSize;
+
+	// Not worth going through the queues
+	if (m_Workers.empty() || batchCount == 1)
+	{
+		for (int i{}; i < count; ++i)
+		{
+			func(i, GetThreadIndex());
+		}
+		return;
+	}
+
+	JobCounter counter{ batchCount };
+	for (int batch{}; batch < batchCount; ++batch)
+	{
+		const int begin = batch * batchSize;
+		const int end = std::min(begin + batchSize, count);
+		Submit([&func, begin, end](int threadIndex)
+			{
+				for (int i{ begin }; i < end; ++i)
+				{
+					func(i, threadIndex);
+				}
+			}, counter);
+	}
+
+	Wait(counter);
+}
+
+void JobSystem::WorkerLoop(int threadIndex)
+{
+	s_ThreadIndex = threadIndex;
+
+	while (true)
+	{
+		if (TryRunJob(threadIndex)) continue;
+
+		std::unique_lock lock{ m_SleepMutex };
+		m_JobAvailable.wait(lock, [this] { return m_IsStopping || m_QueuedJobs.load(std::memory_order_acquire) > 0; });
+		if (m_IsStopping) return;
+	}
+}
+
+void JobSystem::Push(int threadIndex, QueuedJob&& queuedJob)
+{
+	{
+		WorkQueue& queue = *m_Queues[threadIndex];
+		std::lock_guard lock{ queue.mutex };
+		queue.jobs.push_back(std::move(queuedJob));
+	}
+
+	// Taking the sleep mutex makes sure a worker that just found nothing is already waiting to be notified
+	m_QueuedJobs.fetch_add(1, std::memory_order_release);
+	{
+		std::lock_guard lock{ m_SleepMutex };
+	}
+	m_JobAvailable.notify_one();
+}
+
+bool JobSystem::TryRunJob(int threadIndex)
+{
+	QueuedJob queuedJob{};
+	bool hasJob{};
+
+	// Newest job of our own first, it's the most likely to still be in cache
+	{
+		WorkQueue& queue = *m_Queues[threadIndex];
+		std::lock_guard lock{ queue.mutex };
+		if (!queue.jobs.empty())
+		{
+			queuedJob = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			hasJob = true;
+		}
+	}
+
+	// Otherwise steal the oldest job of another thread
+	const int queueCount = static_cast<int>(m_Queues.size());
+	for (int i{ 1 }; !hasJob && i < queueCount; ++i)
+	{
+		WorkQueue& queue = *m_Queues[(threadIndex + i) % queueCount];
+		std::lock_guard lock{ queue.mutex };
+		if (!queue.jobs.empty())
+		{
+			queuedJob = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			hasJob = true;
+		}
+	}
+
+	if (!hasJob) return false;
+
+	m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	queuedJob.job(threadIndex);
+	queuedJob.pCounter->fetch_sub(1, std::memory_order_release);
+	return true;
+}
@@ -0,0 +1,456 @@
+#include "MargolusSandSimulation.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include "InputManager.h"
+#include "JobSystem.h"
+#include "Random.h"
+#include "Utils.h"
+
+#include "imgui.h"
+
+namespace
+{
+	// Same names and colors as the default element types of the grid
+	constexpr std::array<const char*, 5> MATERIAL_NAMES{ "Empty", "Sand", "Water", "Smoke", "Wall" };
+	constexpr std::array<uint32_t, 5> MATERIAL_COLORS{ 0x1A1A1A, 0xD2B48C, 0x3498DB, 0x848884, 0x2b2a2a };
+
+	// Lighter materials rise above heavier ones, walls never move
+	constexpr std::array<int, 5> MATERIAL_DENSITIES{ 1, 3, 2, 0, -1 };
+
+	// Chance per step that the smoke of a block dissipates, about a second per smoke cell at 60 steps a second
+	constexpr uint32_t SMOKE_DISSIPATION_ODDS{ 64 };
+	constexpr int BLOCK_ROWS_PER_JOB{ 8 };
+}
+
+MargolusSandSimulation::MargolusSandSimulation(const GridInfo& gridInfo, Window* window)
+	: m_GridInfo{ gridInfo }
+	, m_pWindow{ window }
+	, m_PaddedColumns{ gridInfo.columns + 2 }
+{
+	// Check if width and height are valid
+	if (gridInfo.rows <= 0 || gridInfo.columns <= 0)
+	{
+		throw std::runtime_error("Rows and Columns must be greater than 0");
+	}
+
+	Init();
+	m_Snapshot = m_Cells;
+}
+
+MargolusSandSimulation::~MargolusSandSimulation()
+{
+	SetThreaded(false);
+
+	if (m_pTexture)
+	{
+		SDL_DestroyTexture(m_pTexture);
+	}
+}
+
+void MargolusSandSimulation::Init()
+{
+	m_Cells.assign(static_cast<size_t>(m_GridInfo.rows + 2) * m_PaddedColumns, Empty);
+	for (int x{}; x < m_GridInfo.rows + 2; ++x)
+	{
+		for (int y{}; y < m_PaddedColumns; ++y)
+		{
+			if (x == 0 || y == 0 || x == m_GridInfo.rows + 1 || y == m_PaddedColumns - 1)
+			{
+				m_Cells[x * m_PaddedColumns + y] = Wall;
+			}
+		}
+	}
+
+	// Build the tables up front instead of on the first step
+	GetTransitionTable();
+}
+
+void MargolusSandSimulation::Update()
+{
+	if (InputManager::GetInstance().IsKeyPressed(SDL_SCANCODE_SPACE))
+	{
+		m_IsSimulating = !m_IsSimulating;
+		std::cout << "TOGGLED SIMULATING\n";
+	}
+
+	if (InputManager::GetInstance().IsKeyPressed(SDL_SCANCODE_S))
+	{
+		m_IsStepRequested = true;
+		std::cout << "STEPPED SIMULATION\n";
+	}
+
+	if (m_IsClearRequested)
+	{
+		m_IsClearRequested = false;
+		m_QueuedCommands.TryPush({ GridCommand::Type::Clear });
+	}
+
+	if (InputManager::GetInstance().IsScrolledUp())
+	{
+		++m_BrushSize;
+	}
+	if (InputManager::GetInstance().IsScrolledDown())
+	{
+		m_BrushSize = std::max(m_BrushSize - 1, 1);
+	}
+
+	const glm::ivec2 gridMousePos = ConvertScreenToGrid(InputManager::GetInstance().GetMousePos());
+	if (gridMousePos == glm::ivec2{ -1, -1 })
+	{
+		m_PreviousMousePos = gridMousePos;
+		return;
+	}
+	if (m_PreviousMousePos == glm::ivec2{ -1, -1 })
+	{
+		m_PreviousMousePos = gridMousePos;
+	}
+
+	const bool isPainting = InputManager::GetInstance().IsMouseButtonHeld(SDL_BUTTON_LEFT);
+	const bool isErasing = InputManager::GetInstance().IsMouseButtonHeld(SDL_BUTTON_RIGHT);
+	if (isPainting || isErasing)
+	{
+		GridCommand stroke{ isErasing ? GridCommand::Type::Erase : GridCommand::Type::Brush, {}, m_BrushSize, false, 1.f, MATERIAL_NAMES[m_SelectedMaterial] };
+		BresenhamLine(m_PreviousMousePos, gridMousePos, [&](int x, int y)
+			{
+				stroke.stamps.emplace_back(x, y);
+				return true;
+			}
+		);
+		if (!m_QueuedCommands.TryPush(std::move(stroke)))
+		{
+			std::cout << "Warning: Command queue is full, stroke dropped!\n";
+		}
+	}
+
+	m_PreviousMousePos = gridMousePos;
+}
+
+void MargolusSandSimulation::FixedUpdate()
+{
+	// The simulation thread steps on its own
+	if (m_SimulationThread.joinable()) return;
+
+	Step();
+}
+
+void MargolusSandSimulation::Step()
+{
+	ApplyCommands();
+
+	if (m_IsSimulating || m_IsStepRequested.exchange(false))
+	{
+		Tick();
+	}
+
+	PublishSnapshot();
+}
+
+void MargolusSandSimulation::Tick()
+{
+	const TransitionTable& table = GetTransitionTable();
+
+	// Blocks start on even cells one step and on odd cells the next, so material crosses block borders
+	const int offset = static_cast<int>(m_TickCount & 1);
+	const int blockRows = (m_GridInfo.rows + 2 - offset) / 2;
+	const int blockColumns = (m_PaddedColumns - offset) / 2;
+
+	JobSystem::GetInstance().ParallelFor(blockRows, BLOCK_ROWS_PER_JOB, [&](int blockRow, int)
+		{
+			const int x = offset + blockRow * 2;
+			uint8_t* top = &m_Cells[x * m_PaddedColumns];
+			uint8_t* bottom = top + m_PaddedColumns;
+
+			for (int blockColumn{}; blockColumn < blockColumns; ++blockColumn)
+			{
+				const int y = offset + blockColumn * 2;
+				const int state = top[y] + MaterialCount * (top[y + 1] + MaterialCount * (bottom[y] + MaterialCount * bottom[y + 1]));
+				if (state == 0) continue;
+
+				CellRandom random{ m_GridInfo.seed, m_TickCount, SIMULATION_RANDOM_STREAM, x, y };
+				const uint32_t roll = random.Next();
+				const int variant = (roll & 1) | ((roll >> 1) % SMOKE_DISSIPATION_ODDS == 0 ? 2 : 0);
+
+				const uint32_t result = table[variant][state];
+				top[y] = static_cast<uint8_t>(result);
+				top[y + 1] = static_cast<uint8_t>(result >> 8);
+				bottom[y] = static_cast<uint8_t>(result >> 16);
+				bottom[y + 1] = static_cast<uint8_t>(result >> 24);
+			}
+		});
+
+	++m_TickCount;
+}
+
+const MargolusSandSimulation::TransitionTable& MargolusSandSimulation::GetTransitionTable()
+{
+	static const TransitionTable table = []
+		{
+			TransitionTable transitions{};
+			for (int variant{}; variant < TRANSITION_VARIANTS; ++variant)
+			{
+				for (int state{}; state < BLOCK_STATES; ++state)
+				{
+					std::array<uint8_t, 4> block{};
+					int remainder = state;
+					for (uint8_t& material : block)
+					{
+						material = static_cast<uint8_t>(remainder % MaterialCount);
+						remainder /= MaterialCount;
+					}
+					transitions[variant][state] = ResolveBlock(block, variant & 1, variant & 2);
+				}
+			}
+			return transitions;
+		}();
+	return table;
+}
+
+uint32_t MargolusSandSimulation::ResolveBlock(std::array<uint8_t, 4> block, bool isMirrored, bool isDissipating)
+{
+	// 0 1  top
+	// 2 3  bottom, gravity points down
+	if (isDissipating)
+	{
+		std::replace(block.begin(), block.end(), static_cast<uint8_t>(Smoke), static_cast<uint8_t>(Empty));
+	}
+	if (isMirrored)
+	{
+		std::swap(block[0], block[1]);
+		std::swap(block[2], block[3]);
+	}
+
+	std::array<bool, 4> hasMoved{};
+	auto swapCells = [&](int first, int second)
+		{
+			std::swap(block[first], block[second]);
+			hasMoved[first] = true;
+			hasMoved[second] = true;
+		};
+
+	// Heavier material on top sinks, straight down first and then diagonally
+	// (the left one first, the mirrored variant handles the right)
+	auto trySink = [&](int upper, int lower)
+		{
+			if (hasMoved[upper] || hasMoved[lower] || block[upper] == Wall || block[lower] == Wall) return;
+			if (MATERIAL_DENSITIES[block[upper]] > MATERIAL_DENSITIES[block[lower]]) swapCells(upper, lower);
+		};
+	trySink(0, 2);
+	trySink(1, 3);
+	trySink(0, 3);
+	trySink(1, 2);
+
+	// Fluids that couldn't fall or rise flow sideways into empty cells, sand stays put
+	auto tryFlow = [&](int left, int right)
+		{
+			if (hasMoved[left] || hasMoved[right]) return;
+			auto isFluid = [&](int index) { return block[index] == Water || block[index] == Smoke; };
+			if ((isFluid(left) && block[right] == Empty) || (isFluid(right) && block[left] == Empty)) swapCells(left, right);
+		};
+	tryFlow(2, 3);
+	tryFlow(0, 1);
+
+	if (isMirrored)
+	{
+		std::swap(block[0], block[1]);
+		std::swap(block[2], block[3]);
+	}
+	return block[0] | (block[1] << 8) | (block[2] << 16) | (static_cast<uint32_t>(block[3]) << 24);
+}
+
+MargolusSandSimulation::Material MargolusSandSimulation::GetMaterial(const std::string& elementTypeName)
+{
+	for (int material{}; material < MaterialCount; ++material)
+	{
+		if (elementTypeName == MATERIAL_NAMES[material]) return static_cast<Material>(material);
+	}
+	return Empty;
+}
+
+void MargolusSandSimulation::ApplyCommands()
+{
+	GridCommand command{};
+	while (m_QueuedCommands.TryPop(command))
+	{
+		switch (command.type)
+		{
+		case GridCommand::Type::Brush:
+			Stamp(command.stamps, command.brushSize, GetMaterial(command.elementTypeName), command.override);
+			break;
+		case GridCommand::Type::Erase:
+			Stamp(command.stamps, command.brushSize, Empty, true);
+			break;
+		case GridCommand::Type::Clear:
+			Init();
+			break;
+		default:
+			// Element types and update modes belong to the grid, the block rules are fixed
+			break;
+		}
+	}
+}
+
+void MargolusSandSimulation::Stamp(const std::vector<glm::ivec2>& stamps, int brushSize, Material material, bool override)
+{
+	const float radius = brushSize - 0.5f; // Fractional brush size
+	const int reach = static_cast<int>(std::ceil(radius));
+
+	for (const glm::ivec2& stamp : stamps)
+	{
+		for (int i = std::max(stamp.x - reach, 0); i <= std::min(stamp.x + reach, m_GridInfo.rows - 1); ++i)
+		{
+			for (int j = std::max(stamp.y - reach, 0); j <= std::min(stamp.y + reach, m_GridInfo.columns - 1); ++j)
+			{
+				const int distanceSquared = (i - stamp.x) * (i - stamp.x) + (j - stamp.y) * (j - stamp.y);
+				uint8_t& cell = m_Cells[(i + 1) * m_PaddedColumns + (j + 1)];
+				if (distanceSquared <= radius * radius && (override || cell == Empty))
+				{
+					cell = material;
+				}
+			}
+		}
+	}
+}
+
+void MargolusSandSimulation::PublishSnapshot()
+{
+	// Never wait for the renderer, the next step publishes again
+	std::unique_lock lock{ m_SnapshotMutex, std::try_to_lock };
+	if (!lock.owns_lock()) return;
+
+	m_Snapshot = m_Cells;
+	++m_SnapshotVersion;
+}
+
+void MargolusSandSimulation::SetThreaded(bool isThreaded)
+{
+	if (isThreaded == m_SimulationThread.joinable()) return;
+
+	if (isThreaded)
+	{
+		m_SimulationThread = std::jthread{ [this](std::stop_token stopToken) { SimulationLoop(stopToken); } };
+	}
+	else
+	{
+		m_SimulationThread.request_stop();
+		m_SimulationThread.join();
+	}
+}
+
+void MargolusSandSimulation::SimulationLoop(std::stop_token stopToken)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto timeStep = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_FixedTimeStep));
+	auto nextStepTime = Clock::now();
+
+	while (!stopToken.stop_requested())
+	{
+		Step();
+
+		// Falling far behind is not worth catching up on
+		nextStepTime += timeStep;
+		const auto now = Clock::now();
+		if (now - nextStepTime > 4 * timeStep)
+		{
+			nextStepTime = now;
+		}
+
+		std::this_thread::sleep_until(nextStepTime);
+	}
+}
+
+void MargolusSandSimulation::Render() const
+{
+	if (!m_pTexture)
+	{
+		m_pTexture = SDL_CreateTexture(
+			m_pWindow->GetSDLRenderer(),
+			SDL_PIXELFORMAT_RGB888,
+			SDL_TEXTUREACCESS_STREAMING,
+			m_GridInfo.columns,
+			m_GridInfo.rows
+		);
+	}
+
+	{
+		std::lock_guard lock{ m_SnapshotMutex };
+		if (m_SnapshotVersion != m_UploadedSnapshotVersion)
+		{
+			m_UploadedSnapshotVersion = m_SnapshotVersion;
+
+			void* pixels;
+			int pitch;
+			SDL_LockTexture(m_pTexture, nullptr, &pixels, &pitch);
+
+			Uint32* pixelData = static_cast<Uint32*>(pixels);
+			const int PIXELS_PER_ROW = pitch / 4; // Uint32 (4 bytes per pixel)
+			for (int x{}; x < m_GridInfo.rows; ++x)
+			{
+				const uint8_t* row = &m_Snapshot[(x + 1) * m_PaddedColumns + 1];
+				Uint32* pixelRow = pixelData + x * PIXELS_PER_ROW;
+				for (int y{}; y < m_GridInfo.columns; ++y)
+				{
+					pixelRow[y] = MATERIAL_COLORS[row[y]];
+				}
+			}
+
+			SDL_UnlockTexture(m_pTexture);
+		}
+	}
+
+	SDL_Rect destRect = {
+		m_GridInfo.pos.x,
+		m_GridInfo.pos.y,
+		m_GridInfo.cellSize * m_GridInfo.columns,
+		m_GridInfo.cellSize * m_GridInfo.rows
+	};
+	SDL_RenderCopy(m_pWindow->GetSDLRenderer(), m_pTexture, nullptr, &destRect);
+
+	ImGui::Begin("Margolus Simulation");
+	ImGui::SetWindowPos("Margolus Simulation", { 1050, 20 });
+	for (int material{ Sand }; material < MaterialCount; ++material)
+	{
+		ImGui::ColorButton(MATERIAL_NAMES[material], HexToImVec4(MATERIAL_COLORS[material]), 0, ImVec2(20, 20));
+		ImGui::SameLine();
+		if (ImGui::Selectable(MATERIAL_NAMES[material], m_SelectedMaterial == material))
+		{
+			m_SelectedMaterial = static_cast<Material>(material);
+		}
+	}
+	ImGui::Text("Brush Size: %d", m_BrushSize);
+	if (ImGui::Button("Clear Grid"))
+	{
+		// queued on the next Update, only the main thread writes the queue
+		m_IsClearRequested = true;
+	}
+	ImGui::End();
+}
+
+bool MargolusSandSimulation::IsActive() const
+{
+	return m_IsSimulating;
+}
+
+float MargolusSandSimulation::GetFixedTimeStep() const
+{
+	return m_FixedTimeStep;
+}
+
+void MargolusSandSimulation::SetFixedTimeStep(float fixedTimeStep)
+{
+	m_FixedTimeStep = fixedTimeStep;
+}
+
+glm::ivec2 MargolusSandSimulation::ConvertScreenToGrid(const glm::ivec2& screenPos) const
+{
+	if (screenPos.x < m_GridInfo.pos.x || screenPos.x >= m_GridInfo.pos.x + m_GridInfo.columns * m_GridInfo.cellSize ||
+		screenPos.y < m_GridInfo.pos.y || screenPos.y >= m_GridInfo.pos.y + m_GridInfo.rows * m_GridInfo.cellSize)
+	{
+		return glm::ivec2(-1, -1); // Out of grid bounds
+	}
+
+	// Screen x runs along the columns, grid x along the rows
+	return glm::ivec2((screenPos.y - m_GridInfo.pos.y) / m_GridInfo.cellSize, (screenPos.x - m_GridInfo.pos.x) / m_GridInfo.cellSize);
+}
@@ -0,0 +1,443 @@
+#include "ShardedWorld.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <array>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Grid's chunk size, bands start on chunk rows and exchange whole ones
+	constexpr int CHUNK_SIZE{ 32 };
+	// the part of an edge row the neighbour can reach into
+	constexpr int HALF_CHUNK_SIZE{ CHUNK_SIZE / 2 };
+
+#ifdef __linux__
+	struct BandResult
+	{
+		double seconds{};
+		int activeChunks{};
+		std::array<int, 256> typeCounts{};
+	};
+
+	enum class RowSlot
+	{
+		// first and last chunk row of the band, published for the neighbours' halos
+		EdgeTop,
+		EdgeBottom,
+		// the halo rows next to the band, handed back to the neighbour owning them
+		HaloBackTop,
+		HaloBackBottom,
+		Count
+	};
+
+	enum class HaloSide
+	{
+		Top,
+		Bottom,
+		Count
+	};
+
+	// Where everything lives in the shared memory:
+	// the barrier, a result per band, the row slots of every band and the element types of the final world
+	class SharedLayout final
+	{
+	public:
+		SharedLayout(int bandCount, int rows, int columns)
+			: m_SlotRecords{ static_cast<size_t>(CHUNK_SIZE) * columns },
+			m_NumChunksY{ static_cast<size_t>(columns + CHUNK_SIZE - 1) / CHUNK_SIZE }
+		{
+			m_ResultsOffset = AlignUp(sizeof(pthread_barrier_t));
+			m_SlotsOffset = AlignUp(m_ResultsOffset + sizeof(BandResult) * bandCount);
+			m_HaloMarksOffset = AlignUp(m_SlotsOffset + sizeof(CellRecord) * m_SlotRecords * static_cast<size_t>(RowSlot::Count) * bandCount);
+			m_WorldTypesOffset = AlignUp(m_HaloMarksOffset + sizeof(DirtyRect) * m_NumChunksY * static_cast<size_t>(HaloSide::Count) * bandCount);
+			m_Size = AlignUp(m_WorldTypesOffset + static_cast<size_t>(rows) * columns);
+		}
+
+		size_t GetSize() const { return m_Size; }
+		pthread_barrier_t* GetBarrier(std::byte* pShared) const { return reinterpret_cast<pthread_barrier_t*>(pShared); }
+		BandResult* GetResults(std::byte* pShared) const { return reinterpret_cast<BandResult*>(pShared + m_ResultsOffset); }
+		const BandResult* GetResults(const std::byte* pShared) const { return reinterpret_cast<const BandResult*>(pShared + m_ResultsOffset); }
+		CellRecord* GetRows(std::byte* pShared, int band, RowSlot slot) const
+		{
+			const size_t slotIndex = static_cast<size_t>(band) * static_cast<size_t>(RowSlot::Count) + static_cast<size_t>(slot);
+			return reinterpret_cast<CellRecord*>(pShared + m_SlotsOffset) + slotIndex * m_SlotRecords;
+		}
+		// marks a band made in its halo during the last phase, for the band owning those rows
+		DirtyRect* GetHaloMarks(std::byte* pShared, int band, HaloSide side) const
+		{
+			const size_t sideIndex = static_cast<size_t>(band) * static_cast<size_t>(HaloSide::Count) + static_cast<size_t>(side);
+			return reinterpret_cast<DirtyRect*>(pShared + m_HaloMarksOffset) + sideIndex * m_NumChunksY;
+		}
+		uint8_t* GetWorldTypes(std::byte* pShared) const { return reinterpret_cast<uint8_t*>(pShared + m_WorldTypesOffset); }
+		const uint8_t* GetWorldTypes(const std::byte* pShared) const { return reinterpret_cast<const uint8_t*>(pShared + m_WorldTypesOffset); }
+	private:
+		static size_t AlignUp(size_t offset) { return (offset + 63) & ~size_t{ 63 }; }
+
+		size_t m_SlotRecords{};
+		size_t m_NumChunksY{};
+		size_t m_ResultsOffset{};
+		size_t m_SlotsOffset{};
+		size_t m_HaloMarksOffset{};
+		size_t m_WorldTypesOffset{};
+		size_t m_Size{};
+	};
+#endif
+}
+
+ShardedWorld::ShardedWorld(const ShardSettings& settings)
+	: m_Settings{ settings }
+{
+	if (m_Settings.bandCount <= 0 || m_Settings.rows <= 0 || m_Settings.columns <= 0)
+	{
+		throw std::runtime_error("Band count, rows and columns must be greater than 0");
+	}
+
+	m_WorldNumChunksX = (m_Settings.rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_BandChunkRows = m_WorldNumChunksX / m_Settings.bandCount;
+
+	// The chunk rows of a band updating at the same time as the neighbours' have to be a chunk row away from them
+	if (m_Settings.bandCount > 1 && m_BandChunkRows < 2)
+	{
+		throw std::runtime_error("Every band needs at least two chunk rows");
+	}
+}
+
+int ShardedWorld::GetBandFirstRow(int band) const
+{
+	return band * m_BandChunkRows * CHUNK_SIZE;
+}
+
+int ShardedWorld::GetBandEndRow(int band) const
+{
+	return band == m_Settings.bandCount - 1 ? m_Settings.rows : GetBandFirstRow(band + 1);
+}
+
+bool ShardedWorld::Run()
+{
+#ifdef __linux__
+	const SharedLayout layout{ m_Settings.bandCount, m_Settings.rows, m_Settings.columns };
+
+	const std::string sharedName = "/FallingSandSim-" + std::to_string(getpid());
+	const int sharedFile = shm_open(sharedName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (sharedFile == -1)
+	{
+		std::cerr << "Failed to create shared memory: " << std::strerror(errno) << '\n';
+		return false;
+	}
+
+	void* pMapping = MAP_FAILED;
+	if (ftruncate(sharedFile, static_cast<off_t>(layout.GetSize())) == 0)
+	{
+		pMapping = mmap(nullptr, layout.GetSize(), PROT_READ | PROT_WRITE, MAP_SHARED, sharedFile, 0);
+	}
+	const int mapError = errno;
+	close(sharedFile);
+	// The bands inherit the mapping, the name is only needed to create it
+	shm_unlink(sharedName.c_str());
+
+	if (pMapping == MAP_FAILED)
+	{
+		std::cerr << "Failed to map shared memory: " << std::strerror(mapError) << '\n';
+		return false;
+	}
+	std::byte* pShared = static_cast<std::byte*>(pMapping);
+
+	pthread_barrierattr_t barrierAttributes{};
+	pthread_barrierattr_init(&barrierAttributes);
+	pthread_barrierattr_setpshared(&barrierAttributes, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(layout.GetBarrier(pShared), &barrierAttributes, m_Settings.bandCount);
+	pthread_barrierattr_destroy(&barrierAttributes);
+
+	// Only the forking thread exists in the bands, so nothing may have started the job system's workers before this.
+	// The bands update serially, their cores are taken by the other bands.
+	std::vector<pid_t> bandProcesses{};
+	bool isSuccessful{ true };
+	for (int band{}; band < m_Settings.bandCount; ++band)
+	{
+		const pid_t process = fork();
+		if (process == 0)
+		{
+			int exitCode{};
+			try
+			{
+				RunBand(band, pShared);
+			}
+			catch (const std::exception& exception)
+			{
+				std::cerr << "Band " << band << " failed: " << exception.what() << '\n';
+				exitCode = 1;
+			}
+			std::cout.flush();
+			// skips the destructors of the parent's statics
+			_exit(exitCode);
+		}
+
+		if (process == -1)
+		{
+			std::cerr << "Failed to start band " << band << ": " << std::strerror(errno) << '\n';
+			isSuccessful = false;
+			break;
+		}
+		bandProcesses.push_back(process);
+	}
+
+	// A band that is gone leaves the others waiting at the barrier forever
+	if (!isSuccessful)
+	{
+		for (pid_t process : bandProcesses) kill(process, SIGKILL);
+	}
+
+	for (size_t remaining{ bandProcesses.size() }; remaining > 0; --remaining)
+	{
+		int status{};
+		const pid_t process = wait(&status);
+		if (process == -1) break;
+
+		if (isSuccessful && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+		{
+			isSuccessful = false;
+			for (pid_t otherProcess : bandProcesses)
+			{
+				if (otherProcess != process) kill(otherProcess, SIGKILL);
+			}
+		}
+	}
+
+	if (isSuccessful)
+	{
+		PrintResults(pShared);
+	}
+	else
+	{
+		std::cerr << "Sharded run failed\n";
+	}
+
+	pthread_barrier_destroy(layout.GetBarrier(pShared));
+	munmap(pMapping, layout.GetSize());
+	return isSuccessful;
+#else
+	std::cerr << "Sharded worlds need POSIX shared memory and processes, only supported on Linux\n";
+	return false;
+#endif
+}
+
+void ShardedWorld::RunBand(int band, std::byte* pShared) const
+{
+#ifdef __linux__
+	using Clock = std::chrono::steady_clock;
+
+	const SharedLayout layout{ m_Settings.bandCount, m_Settings.rows, m_Settings.columns };
+	pthread_barrier_t* pBarrier = layout.GetBarrier(pShared);
+
+	const int firstRow = GetBandFirstRow(band);
+	const int endRow = GetBandEndRow(band);
+	const bool hasTopBand = band > 0;
+	const bool hasBottomBand = band < m_Settings.bandCount - 1;
+
+	// Local rows: the halo of the band above, the band itself, the halo of the band below
+	const int topHaloRows = hasTopBand ? CHUNK_SIZE : 0;
+	const int bottomHaloRows = hasBottomBand ? CHUNK_SIZE : 0;
+	const int bandRows = endRow - firstRow;
+	const int bandEnd = topHaloRows + bandRows;
+
+	Grid grid{ GridInfo{ glm::ivec2{}, bandEnd + bottomHaloRows, m_Settings.columns, 1, GridLayout::RowMajor, m_Settings.seed } };
+	if (grid.GetChunkSize() != CHUNK_SIZE)
+	{
+		throw std::runtime_error("Grid chunk size doesn't match the band exchange");
+	}
+	grid.SetFixedTimeStep(m_Settings.fixedTimeStep);
+
+	const auto refreshHalo = [&]()
+		{
+			if (hasTopBand) grid.ExportRows(topHaloRows, CHUNK_SIZE, layout.GetRows(pShared, band, RowSlot::EdgeTop));
+			if (hasBottomBand) grid.ExportRows(bandEnd - CHUNK_SIZE, CHUNK_SIZE, layout.GetRows(pShared, band, RowSlot::EdgeBottom));
+			pthread_barrier_wait(pBarrier);
+
+			if (hasTopBand) grid.ImportRows(0, CHUNK_SIZE, layout.GetRows(pShared, band - 1, RowSlot::EdgeBottom));
+			if (hasBottomBand) grid.ImportRows(bandEnd, CHUNK_SIZE, layout.GetRows(pShared, band + 1, RowSlot::EdgeTop));
+		};
+
+	const int bottomParity = (m_WorldNumChunksX - 1) % 2;
+	const int topEdgeParity = (firstRow / CHUNK_SIZE) % 2;
+	const int bottomEdgeParity = ((endRow - 1) / CHUNK_SIZE) % 2;
+	int rowPhase{};
+
+	const auto exchangeRows = [&]()
+		{
+			const int updatedParity = (bottomParity + rowPhase) % 2;
+			rowPhase ^= 1;
+
+			// The halo rows next to the band are the only ones of the neighbours this band can have changed.
+			// Whatever it woke up there goes along, so the neighbour updates the same chunks a single grid would.
+			if (hasTopBand)
+			{
+				grid.ExportRows(topHaloRows - HALF_CHUNK_SIZE, HALF_CHUNK_SIZE, layout.GetRows(pShared, band, RowSlot::HaloBackTop));
+				grid.ExportDirtyRects(0, layout.GetHaloMarks(pShared, band, HaloSide::Top));
+			}
+			if (hasBottomBand)
+			{
+				grid.ExportRows(bandEnd, HALF_CHUNK_SIZE, layout.GetRows(pShared, band, RowSlot::HaloBackBottom));
+				grid.ExportDirtyRects(bandEnd / CHUNK_SIZE, layout.GetHaloMarks(pShared, band, HaloSide::Bottom));
+			}
+			pthread_barrier_wait(pBarrier);
+
+			if (hasTopBand) grid.ImportDirtyRects(layout.GetHaloMarks(pShared, band - 1, HaloSide::Bottom));
+			if (hasBottomBand) grid.ImportDirtyRects(layout.GetHaloMarks(pShared, band + 1, HaloSide::Top));
+
+			// The neighbour only reached into an edge row while the chunk row next to it (the other parity) updated
+			if (hasTopBand && topEdgeParity != updatedParity)
+			{
+				grid.ImportRows(topHaloRows, HALF_CHUNK_SIZE, layout.GetRows(pShared, band - 1, RowSlot::HaloBackBottom));
+			}
+			if (hasBottomBand && bottomEdgeParity != updatedParity)
+			{
+				grid.ImportRows(bandEnd - HALF_CHUNK_SIZE, HALF_CHUNK_SIZE, layout.GetRows(pShared, band + 1, RowSlot::HaloBackTop));
+			}
+
+			refreshHalo();
+		};
+
+	grid.SetBand(GridBand{ topHaloRows / CHUNK_SIZE, (bandEnd - 1) / CHUNK_SIZE, firstRow - topHaloRows, m_WorldNumChunksX, exchangeRows });
+	// After the band is set, the elements roll their random values by world row
+	SetupBand(grid, band, topHaloRows);
+	refreshHalo();
+
+	const auto startTime = Clock::now();
+	for (int tick{}; tick < m_Settings.ticks; ++tick)
+	{
+		grid.FixedUpdate();
+	}
+
+	BandResult& result = layout.GetResults(pShared)[band];
+	result.seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+	const GridBand* pBand = grid.GetBand();
+	for (int chunkIndex : grid.m_CurrentDirtyChunks.GetActiveChunks())
+	{
+		const int chunkX = chunkIndex / grid.GetNumChunksY();
+		if (chunkX >= pBand->firstChunkX && chunkX <= pBand->lastChunkX) ++result.activeChunks;
+	}
+
+	std::vector<CellRecord> records(static_cast<size_t>(bandRows) * m_Settings.columns);
+	grid.ExportRows(topHaloRows, bandRows, records.data());
+	uint8_t* pWorldTypes = layout.GetWorldTypes(pShared) + static_cast<size_t>(firstRow) * m_Settings.columns;
+	for (size_t i{}; i < records.size(); ++i)
+	{
+		pWorldTypes[i] = GetCellType(records[i].cell);
+		++result.typeCounts[pWorldTypes[i]];
+	}
+#else
+	(void)band;
+	(void)pShared;
+#endif
+}
+
+void ShardedWorld::SetupBand(Grid& grid, int band, int haloRows) const
+{
+	// Fire, smoke and snow roll their lifetimes, fire spreads into the wood
+	constexpr std::array<const char*, 6> ELEMENT_NAMES{ "Sand", "Water", "Wood", "Fire", "Smoke", "Snow" };
+
+	const int rows = m_Settings.rows;
+	const int columns = m_Settings.columns;
+	const int firstRow = GetBandFirstRow(band);
+	const int endRow = GetBandEndRow(band);
+
+	// Every band rolls the whole world and keeps the cells in its rows
+	const auto addElement = [&](int x, int y, const char* elementName)
+		{
+			if (x < firstRow || x >= endRow || y < 0 || y >= columns) return;
+			grid.AddElementAt(x - firstRow + haloRows, y, elementName);
+		};
+
+	CellRandom random{ m_Settings.seed, 0, EDIT_RANDOM_STREAM, -1, -1 };
+
+	// Ledges so the falling elements pile up and flow off them, across band borders too
+	for (int ledge{}; ledge < m_WorldNumChunksX; ++ledge)
+	{
+		const int x = random.NextInt(rows / 4, rows - 1);
+		const int startY = random.NextInt(0, columns - 1);
+		const int length = random.NextInt(columns / 8, columns / 3);
+		for (int y{ startY }; y < startY + length; ++y)
+		{
+			addElement(x, y, "Wall");
+		}
+	}
+
+	for (const char* elementName : ELEMENT_NAMES)
+	{
+		for (int blob{}; blob < m_WorldNumChunksX; ++blob)
+		{
+			const int centerX = random.NextInt(0, rows - 1);
+			const int centerY = random.NextInt(0, columns - 1);
+			const int radius = random.NextInt(2, 12);
+			for (int x{ -radius }; x <= radius; ++x)
+			{
+				for (int y{ -radius }; y <= radius; ++y)
+				{
+					if (x * x + y * y <= radius * radius) addElement(centerX + x, centerY + y, elementName);
+				}
+			}
+		}
+	}
+}
+
+void ShardedWorld::PrintResults(const std::byte* pShared) const
+{
+#ifdef __linux__
+	const SharedLayout layout{ m_Settings.bandCount, m_Settings.rows, m_Settings.columns };
+	const BandResult* pResults = layout.GetResults(pShared);
+	// The bands run the default element set, so their type ids match a fresh registry
+	const ElementRegistry registry{};
+
+	std::cout << "Ran a " << m_Settings.rows << "x" << m_Settings.columns << " world in " << m_Settings.bandCount
+		<< " bands for " << m_Settings.ticks << " ticks\n";
+
+	std::array<int, 256> typeCounts{};
+	for (int band{}; band < m_Settings.bandCount; ++band)
+	{
+		const BandResult& result = pResults[band];
+		const double ticksPerSecond = result.seconds > 0.0 ? m_Settings.ticks / result.seconds : 0.0;
+		std::cout << "Band " << band << " (rows " << GetBandFirstRow(band) << "-" << GetBandEndRow(band) - 1 << "): "
+			<< std::fixed << std::setprecision(1) << ticksPerSecond << " ticks/s, " << result.activeChunks << " active chunks\n";
+
+		for (size_t typeID{}; typeID < typeCounts.size(); ++typeID)
+		{
+			typeCounts[typeID] += result.typeCounts[typeID];
+		}
+	}
+
+	std::cout << "Elements:";
+	for (size_t typeID{ 1 }; typeID < std::min(typeCounts.size(), registry.GetElementTypeCount()); ++typeID)
+	{
+		if (typeCounts[typeID] == 0) continue;
+		std::cout << ' ' << registry.GetElementType(static_cast<ElementTypeID>(typeID))->name << ' ' << typeCounts[typeID];
+	}
+	std::cout << '\n';
+
+	// The same for any number of bands, a quick check that the exchange lost or duplicated nothing
+	uint64_t checksum{ 0xcbf29ce484222325ULL };
+	const uint8_t* pWorldTypes = layout.GetWorldTypes(pShared);
+	for (size_t i{}; i < static_cast<size_t>(m_Settings.rows) * m_Settings.columns; ++i)
+	{
+		checksum = (checksum ^ pWorldTypes[i]) * 0x100000001b3ULL;
+	}
+	std::cout << "World checksum: " << std::hex << std::setw(16) << std::setfill('0') << checksum << std::dec << std::setfill(' ') << '\n';
+#else
+	(void)pShared;
+#endif
+}
@@ -0,0 +1,453 @@
+#include "SimdKernels.h"
+#include "ColorKernel.h"
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang only emit the instructions of a set in functions that target it, MSVC takes the intrinsics anywhere.
+// Targeting single functions instead of compiling whole files for a set keeps the inline functions they use
+// (shared by the whole program) compiled for the baseline
+#if defined(SIMD_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET(instructionSets) __attribute__((target(instructionSets)))
+#else
+#define SIMD_TARGET(instructionSets)
+#endif
+
+namespace
+{
+	namespace Scalar
+	{
+		void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels)
+		{
+			for (int i{}; i < count; ++i)
+			{
+				pPixels[i] = ConvertCellColor(pCells[i], pColors);
+			}
+		}
+
+		uint64_t FindOccupiedCells(const Cell* pCells, int count)
+		{
+			uint64_t occupied{};
+			for (int i{}; i < count; ++i)
+			{
+				occupied |= static_cast<uint64_t>(pCells[i] != EMPTY_CELL_STATE) << i;
+			}
+			return occupied;
+		}
+
+		bool AreCellsEmpty(const Cell* pCells, int count)
+		{
+			return std::all_of(pCells, pCells + count, [](Cell cell) { return cell == EMPTY_CELL_STATE; });
+		}
+
+		void AddStampCoverage(uint8_t* pCoverage, int count, int firstOffset, int rowDistanceSquared, float radiusSquared)
+		{
+			for (int i{}; i < count; ++i)
+			{
+				// Same circle as a single stamp, compared squared
+				const int offset = firstOffset + i;
+				if (rowDistanceSquared + offset * offset <= radiusSquared && pCoverage[i] < UINT8_MAX)
+				{
+					++pCoverage[i];
+				}
+			}
+		}
+	}
+
+#if defined(SIMD_KERNELS_X86)
+	namespace SSE42
+	{
+		// The tint byte of every cell copied into its red, green and blue bytes
+		// and split in what gets added and what gets subtracted, so unsigned saturating byte math does the clamping
+		struct TintBytes
+		{
+			__m128i add;
+			__m128i subtract;
+		};
+
+		SIMD_TARGET("sse4.2") TintBytes SplitTints(__m128i cells)
+		{
+			const __m128i tint = _mm_and_si128(_mm_srli_epi32(cells, 8), _mm_set1_epi32(0xFF));
+			const __m128i tints = _mm_or_si128(_mm_or_si128(tint, _mm_slli_epi32(tint, 8)), _mm_slli_epi32(tint, 16));
+
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i isNegative = _mm_cmpgt_epi8(zero, tints);
+			return { _mm_andnot_si128(isNegative, tints), _mm_and_si128(isNegative, _mm_sub_epi8(zero, tints)) };
+		}
+
+		SIMD_TARGET("sse4.2") void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels)
+		{
+			int i{};
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCells + i));
+				// No gather before AVX2, the table lookups stay scalar
+				const __m128i baseColors = _mm_setr_epi32(
+					static_cast<int>(pColors[GetCellType(pCells[i])]),
+					static_cast<int>(pColors[GetCellType(pCells[i + 1])]),
+					static_cast<int>(pColors[GetCellType(pCells[i + 2])]),
+					static_cast<int>(pColors[GetCellType(pCells[i + 3])]));
+				const TintBytes tints = SplitTints(cells);
+				const __m128i colors = _mm_subs_epu8(_mm_adds_epu8(baseColors, tints.add), tints.subtract);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + i), colors);
+			}
+			Scalar::ConvertCellColors(pCells + i, count - i, pColors, pPixels + i);
+		}
+
+		SIMD_TARGET("sse4.2") uint64_t FindOccupiedCells(const Cell* pCells, int count)
+		{
+			uint64_t occupied{};
+			int i{};
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCells + i));
+				const int emptyCells = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cells, _mm_setzero_si128())));
+				occupied |= static_cast<uint64_t>(~emptyCells & 0xF) << i;
+			}
+			if (i < count) occupied |= Scalar::FindOccupiedCells(pCells + i, count - i) << i;
+			return occupied;
+		}
+
+		SIMD_TARGET("sse4.2") bool AreCellsEmpty(const Cell* pCells, int count)
+		{
+			int i{};
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCells + i));
+				if (!_mm_testz_si128(cells, cells)) return false;
+			}
+			return Scalar::AreCellsEmpty(pCells + i, count - i);
+		}
+
+		// All ones in the lanes of the 4 cells from firstOffset on that lie within the stamp
+		SIMD_TARGET("sse4.2") __m128i IsWithinStamp(int firstOffset, __m128i rowDistanceSquared, __m128 radiusSquared)
+		{
+			const __m128i offsets = _mm_add_epi32(_mm_set1_epi32(firstOffset), _mm_setr_epi32(0, 1, 2, 3));
+			const __m128i distancesSquared = _mm_add_epi32(rowDistanceSquared, _mm_mullo_epi32(offsets, offsets));
+			return _mm_castps_si128(_mm_cmple_ps(_mm_cvtepi32_ps(distancesSquared), radiusSquared));
+		}
+
+		SIMD_TARGET("sse4.2") void AddStampCoverage(uint8_t* pCoverage, int count, int firstOffset, int rowDistanceSquared, float radiusSquared)
+		{
+			const __m128i rowDistances = _mm_set1_epi32(rowDistanceSquared);
+			const __m128 radius = _mm_set1_ps(radiusSquared);
+			int i{};
+			for (; i + 16 <= count; i += 16)
+			{
+				// Packing the lane masks keeps them all ones or zero, one byte per cell
+				const __m128i first = _mm_packs_epi32(IsWithinStamp(firstOffset + i, rowDistances, radius), IsWithinStamp(firstOffset + i + 4, rowDistances, radius));
+				const __m128i second = _mm_packs_epi32(IsWithinStamp(firstOffset + i + 8, rowDistances, radius), IsWithinStamp(firstOffset + i + 12, rowDistances, radius));
+				const __m128i hits = _mm_and_si128(_mm_packs_epi16(first, second), _mm_set1_epi8(1));
+
+				__m128i* pCoverageBytes = reinterpret_cast<__m128i*>(pCoverage + i);
+				_mm_storeu_si128(pCoverageBytes, _mm_adds_epu8(_mm_loadu_si128(pCoverageBytes), hits));
+			}
+			Scalar::AddStampCoverage(pCoverage + i, count - i, firstOffset + i, rowDistanceSquared, radiusSquared);
+		}
+	}
+
+	namespace AVX2
+	{
+		struct TintBytes
+		{
+			__m256i add;
+			__m256i subtract;
+		};
+
+		SIMD_TARGET("avx2") TintBytes SplitTints(__m256i cells)
+		{
+			const __m256i tint = _mm256_and_si256(_mm256_srli_epi32(cells, 8), _mm256_set1_epi32(0xFF));
+			const __m256i tints = _mm256_or_si256(_mm256_or_si256(tint, _mm256_slli_epi32(tint, 8)), _mm256_slli_epi32(tint, 16));
+
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i isNegative = _mm256_cmpgt_epi8(zero, tints);
+			return { _mm256_andnot_si256(isNegative, tints), _mm256_and_si256(isNegative, _mm256_sub_epi8(zero, tints)) };
+		}
+
+		SIMD_TARGET("avx2") void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels)
+		{
+			const __m256i typeMask = _mm256_set1_epi32(0xFF);
+			int i{};
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i cells = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pCells + i));
+				const __m256i baseColors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(pColors), _mm256_and_si256(cells, typeMask), 4);
+				const TintBytes tints = SplitTints(cells);
+				const __m256i colors = _mm256_subs_epu8(_mm256_adds_epu8(baseColors, tints.add), tints.subtract);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pPixels + i), colors);
+			}
+			Scalar::ConvertCellColors(pCells + i, count - i, pColors, pPixels + i);
+		}
+
+		SIMD_TARGET("avx2") uint64_t FindOccupiedCells(const Cell* pCells, int count)
+		{
+			uint64_t occupied{};
+			int i{};
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i cells = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pCells + i));
+				const int emptyCells = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cells, _mm256_setzero_si256())));
+				occupied |= static_cast<uint64_t>(~emptyCells & 0xFF) << i;
+			}
+			if (i < count) occupied |= Scalar::FindOccupiedCells(pCells + i, count - i) << i;
+			return occupied;
+		}
+
+		SIMD_TARGET("avx2") bool AreCellsEmpty(const Cell* pCells, int count)
+		{
+			int i{};
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256i cells = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pCells + i));
+				if (!_mm256_testz_si256(cells, cells)) return false;
+			}
+			return Scalar::AreCellsEmpty(pCells + i, count - i);
+		}
+
+		SIMD_TARGET("avx2") __m256i IsWithinStamp(int firstOffset, __m256i rowDistanceSquared, __m256 radiusSquared)
+		{
+			const __m256i offsets = _mm256_add_epi32(_mm256_set1_epi32(firstOffset), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			const __m256i distancesSquared = _mm256_add_epi32(rowDistanceSquared, _mm256_mullo_epi32(offsets, offsets));
+			return _mm256_castps_si256(_mm256_cmp_ps(_mm256_cvtepi32_ps(distancesSquared), radiusSquared, _CMP_LE_OQ));
+		}
+
+		SIMD_TARGET("avx2") void AddStampCoverage(uint8_t* pCoverage, int count, int firstOffset, int rowDistanceSquared, float radiusSquared)
+		{
+			const __m256i rowDistances = _mm256_set1_epi32(rowDistanceSquared);
+			const __m256 radius = _mm256_set1_ps(radiusSquared);
+			int i{};
+			for (; i + 32 <= count; i += 32)
+			{
+				const __m256i first = _mm256_packs_epi32(IsWithinStamp(firstOffset + i, rowDistances, radius), IsWithinStamp(firstOffset + i + 8, rowDistances, radius));
+				const __m256i second = _mm256_packs_epi32(IsWithinStamp(firstOffset + i + 16, rowDistances, radius), IsWithinStamp(firstOffset + i + 24, rowDistances, radius));
+				// The packs work per 128 bit half, which leaves the groups of 4 cells interleaved
+				const __m256i packed = _mm256_packs_epi16(first, second);
+				const __m256i hits = _mm256_and_si256(_mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)), _mm256_set1_epi8(1));
+
+				__m256i* pCoverageBytes = reinterpret_cast<__m256i*>(pCoverage + i);
+				_mm256_storeu_si256(pCoverageBytes, _mm256_adds_epu8(_mm256_loadu_si256(pCoverageBytes), hits));
+			}
+			SSE42::AddStampCoverage(pCoverage + i, count - i, firstOffset + i, rowDistanceSquared, radiusSquared);
+		}
+	}
+
+	// GCC 12 warns about the undefined vectors its AVX-512 headers start some intrinsics from, they are harmless
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+	namespace AVX512
+	{
+		// The first count lanes of 16, the tails are done with masked loads and stores instead of a scalar loop
+		SIMD_TARGET("avx512f,avx512bw") __mmask16 GetLaneMask(int count)
+		{
+			return count >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << count) - 1);
+		}
+
+		SIMD_TARGET("avx512f,avx512bw") void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels)
+		{
+			const __m512i typeMask = _mm512_set1_epi32(0xFF);
+			const __m512i zero = _mm512_setzero_si512();
+			for (int i{}; i < count; i += 16)
+			{
+				const __mmask16 lanes = GetLaneMask(count - i);
+				const __m512i cells = _mm512_maskz_loadu_epi32(lanes, pCells + i);
+				const __m512i baseColors = _mm512_mask_i32gather_epi32(zero, lanes, _mm512_and_si512(cells, typeMask), pColors, 4);
+
+				const __m512i tint = _mm512_and_si512(_mm512_srli_epi32(cells, 8), typeMask);
+				const __m512i tints = _mm512_or_si512(_mm512_or_si512(tint, _mm512_slli_epi32(tint, 8)), _mm512_slli_epi32(tint, 16));
+				const __mmask64 isNegative = _mm512_cmplt_epi8_mask(tints, zero);
+				const __m512i added = _mm512_adds_epu8(baseColors, _mm512_maskz_mov_epi8(~isNegative, tints));
+				const __m512i colors = _mm512_subs_epu8(added, _mm512_maskz_sub_epi8(isNegative, zero, tints));
+				_mm512_mask_storeu_epi32(pPixels + i, lanes, colors);
+			}
+		}
+
+		SIMD_TARGET("avx512f,avx512bw") uint64_t FindOccupiedCells(const Cell* pCells, int count)
+		{
+			uint64_t occupied{};
+			for (int i{}; i < count; i += 16)
+			{
+				const __m512i cells = _mm512_maskz_loadu_epi32(GetLaneMask(count - i), pCells + i);
+				occupied |= static_cast<uint64_t>(_mm512_test_epi32_mask(cells, cells)) << i;
+			}
+			return occupied;
+		}
+
+		SIMD_TARGET("avx512f,avx512bw") bool AreCellsEmpty(const Cell* pCells, int count)
+		{
+			for (int i{}; i < count; i += 16)
+			{
+				const __m512i cells = _mm512_maskz_loadu_epi32(GetLaneMask(count - i), pCells + i);
+				if (_mm512_test_epi32_mask(cells, cells)) return false;
+			}
+			return true;
+		}
+
+		SIMD_TARGET("avx512f,avx512bw") void AddStampCoverage(uint8_t* pCoverage, int count, int firstOffset, int rowDistanceSquared, float radiusSquared)
+		{
+			const __m512i laneOffsets = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+			const __m512i rowDistances = _mm512_set1_epi32(rowDistanceSquared);
+			const __m512 radius = _mm512_set1_ps(radiusSquared);
+			int i{};
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m512i offsets = _mm512_add_epi32(_mm512_set1_epi32(firstOffset + i), laneOffsets);
+				const __m512i distancesSquared = _mm512_add_epi32(rowDistances, _mm512_mullo_epi32(offsets, offsets));
+				const __mmask16 isWithin = _mm512_cmp_ps_mask(_mm512_cvtepi32_ps(distancesSquared), radius, _CMP_LE_OQ);
+				// A one in every lane within the stamp, narrowed to a byte per cell
+				const __m128i hits = _mm512_cvtepi32_epi8(_mm512_maskz_set1_epi32(isWithin, 1));
+
+				__m128i* pCoverageBytes = reinterpret_cast<__m128i*>(pCoverage + i);
+				_mm_storeu_si128(pCoverageBytes, _mm_adds_epu8(_mm_loadu_si128(pCoverageBytes), hits));
+			}
+			SSE42::AddStampCoverage(pCoverage + i, count - i, firstOffset + i, rowDistanceSquared, radiusSquared);
+		}
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+	// Indexed by SimdLevel, only the scalar versions exist off x86
+	constexpr SimdKernels KERNELS[]
+	{
+		{ Scalar::ConvertCellColors, Scalar::FindOccupiedCells, Scalar::AreCellsEmpty, Scalar::AddStampCoverage },
+#if defined(SIMD_KERNELS_X86)
+		{ SSE42::ConvertCellColors, SSE42::FindOccupiedCells, SSE42::AreCellsEmpty, SSE42::AddStampCoverage },
+		{ AVX2::ConvertCellColors, AVX2::FindOccupiedCells, AVX2::AreCellsEmpty, AVX2::AddStampCoverage },
+		{ AVX512::ConvertCellColors, AVX512::FindOccupiedCells, AVX512::AreCellsEmpty, AVX512::AddStampCoverage },
+#endif
+	};
+
+	constexpr std::array<const char*, 4> SIMD_LEVEL_NAMES{ "scalar", "sse4.2", "avx2", "avx512" };
+
+#if defined(SIMD_KERNELS_X86)
+	// eax, ebx, ecx and edx
+	std::array<uint32_t, 4> ReadCpuid(uint32_t leaf, uint32_t subleaf)
+	{
+		std::array<uint32_t, 4> registers{};
+#if defined(_MSC_VER)
+		int values[4];
+		__cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+		std::copy_n(values, 4, registers.begin());
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+		return registers;
+	}
+
+	// The register states the OS saves on a context switch (XCR0), only readable when CPUID reports OSXSAVE
+	uint64_t ReadSavedRegisterStates()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t low, high;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+	}
+#endif
+
+	SimdLevel DetectSimdLevel()
+	{
+#if defined(SIMD_KERNELS_X86)
+		constexpr uint64_t AVX_STATES{ 0x6 }; // SSE and AVX registers
+		constexpr uint64_t AVX512_STATES{ 0xE6 }; // and the mask and upper AVX-512 registers
+
+		const uint32_t maxLeaf = ReadCpuid(0, 0)[0];
+		const std::array<uint32_t, 4> features = ReadCpuid(1, 0);
+		if (!(features[2] & (1u << 20))) return SimdLevel::Scalar;
+
+		// The wider registers also need the OS to save them, or their upper halves get lost on a context switch
+		const bool hasOSXSave = (features[2] & (1u << 27)) && (features[2] & (1u << 28));
+		const uint64_t savedStates = hasOSXSave ? ReadSavedRegisterStates() : 0;
+		if ((savedStates & AVX_STATES) != AVX_STATES || maxLeaf < 7) return SimdLevel::SSE42;
+
+		const std::array<uint32_t, 4> extendedFeatures = ReadCpuid(7, 0);
+		if (!(extendedFeatures[1] & (1u << 5))) return SimdLevel::SSE42;
+
+		const bool hasAVX512 = (extendedFeatures[1] & (1u << 16)) && (extendedFeatures[1] & (1u << 30));
+		if (!hasAVX512 || (savedStates & AVX512_STATES) != AVX512_STATES) return SimdLevel::AVX2;
+		return SimdLevel::AVX512;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	SimdLevel GetStartupSimdLevel()
+	{
+		const SimdLevel supportedLevel = GetSupportedSimdLevel();
+		const char* pRequestedName = std::getenv("SAND_SIMD");
+		if (!pRequestedName) return supportedLevel;
+
+		const std::optional<SimdLevel> requestedLevel = ParseSimdLevel(pRequestedName);
+		if (!requestedLevel)
+		{
+			std::cerr << "Unknown SAND_SIMD level " << pRequestedName << ", using " << GetSimdLevelName(supportedLevel) << std::endl;
+			return supportedLevel;
+		}
+		return std::min(*requestedLevel, supportedLevel);
+	}
+
+	std::atomic<SimdLevel>& GetCurrentSimdLevel()
+	{
+		static std::atomic<SimdLevel> currentLevel{ GetStartupSimdLevel() };
+		return currentLevel;
+	}
+}
+
+SimdLevel GetSupportedSimdLevel()
+{
+	static const SimdLevel supportedLevel{ DetectSimdLevel() };
+	return supportedLevel;
+}
+
+SimdLevel GetSimdLevel()
+{
+	return GetCurrentSimdLevel().load(std::memory_order_relaxed);
+}
+
+SimdLevel SetSimdLevel(SimdLevel level)
+{
+	level = std::min(level, GetSupportedSimdLevel());
+	GetCurrentSimdLevel().store(level, std::memory_order_relaxed);
+	return level;
+}
+
+const char* GetSimdLevelName(SimdLevel level)
+{
+	return SIMD_LEVEL_NAMES[static_cast<size_t>(level)];
+}
+
+std::optional<SimdLevel> ParseSimdLevel(std::string_view name)
+{
+	for (size_t level{}; level < SIMD_LEVEL_NAMES.size(); ++level)
+	{
+		if (name == SIMD_LEVEL_NAMES[level]) return static_cast<SimdLevel>(level);
+	}
+	return std::nullopt;
+}
+
+const SimdKernels& GetSimdKernels()
+{
+	return KERNELS[static_cast<size_t>(GetSimdLevel())];
+}
+
+void ConvertCellColors(const Cell* pCells, int count, const uint32_t* pColors, uint32_t* pPixels)
+{
+	GetSimdKernels().convertCellColors(pCells, count, pColors, pPixels);
+}
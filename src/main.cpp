@@ -1,11 +1,44 @@
 #include "Game.h"
+#include "BatchRunner.h"
+#include "ShardedWorld.h"
+#include <string>
+#include <cstdlib>
 
 int main(int argc, char* args[])
 {
-    srand(std::time(nullptr));
+    // FallingSandSim --batch [worlds] [ticks] [rows] [columns] [seed]
+    // runs independent worlds on all cores without opening a window
+    if (argc > 1 && std::string{ args[1] } == "--batch")
+    {
+        BatchSettings settings{};
+        if (argc > 2) settings.worldCount = std::atoi(args[2]);
+        if (argc > 3) settings.ticks = std::atoi(args[3]);
+        if (argc > 4) settings.rows = std::atoi(args[4]);
+        if (argc > 5) settings.columns = std::atoi(args[5]);
+        if (argc > 6) settings.seed = std::strtoull(args[6], nullptr, 10);
+
+        BatchRunner batchRunner{ settings };
+        batchRunner.Run();
+        return 0;
+    }
+
+    // FallingSandSim --shards [bands] [ticks] [rows] [columns] [seed]
+    // runs one world split into bands over separate processes (Linux only)
+    if (argc > 1 && std::string{ args[1] } == "--shards")
+    {
+        ShardSettings settings{};
+        if (argc > 2) settings.bandCount = std::atoi(args[2]);
+        if (argc > 3) settings.ticks = std::atoi(args[3]);
+        if (argc > 4) settings.rows = std::atoi(args[4]);
+        if (argc > 5) settings.columns = std::atoi(args[5]);
+        if (argc > 6) settings.seed = std::strtoull(args[6], nullptr, 10);
+
+        ShardedWorld shardedWorld{ settings };
+        return shardedWorld.Run() ? 0 : 1;
+    }
 
     Game game;
     game.Run();
 
     return 0;
-}
\ No newline at end of file
+}